@@ -0,0 +1,31 @@
+#ifndef FFMPEG_DEMO_BLEND_TOOL_H
+#define FFMPEG_DEMO_BLEND_TOOL_H
+
+#include <cstddef>
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// 单行混合：dst 为 RGB24，src 为预乘 RGBA，n 为像素数
+typedef void (*blend_row_fn)(uint8_t *dst, const uint8_t *src, int n);
+
+// 选择混合内核，name 为 auto/scalar/sse4.1/avx2，启动时先与标量内核逐位比对
+int blend_init(const char *name);
+
+const char *blend_kernel_name();
+
+// 与标量内核逐位比对，返回不一致的内核数
+int blend_self_check();
+
+// 将 RGBA 转为预乘 RGBA
+void blend_premultiply(uint8_t *rgba, size_t pixels);
+
+// 预乘 RGBA 叠加到 RGB24 帧的 (x, y) 处，超出帧的部分被裁剪
+void blend_rgba_to_rgb24(AVFrame *frame, const uint8_t *rgba, int width, int height, int stride, int x, int y);
+
+// YUVA444P 叠加图混合到 YUV420P 帧的 (x, y) 处，色度按 2x2 块内 alpha 加权，奇数坐标同样正确
+void blend_yuva_to_yuv420p(AVFrame *frame, const AVFrame *overlay, int x, int y);
+
+#endif //FFMPEG_DEMO_BLEND_TOOL_H
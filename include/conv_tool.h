@@ -0,0 +1,62 @@
+#ifndef FFMPEG_DEMO_CONV_TOOL_H
+#define FFMPEG_DEMO_CONV_TOOL_H
+
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+
+#include "seq_tool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CONV_CACHE_SIZE 4
+
+typedef struct ConvCacheEntry {
+    struct SwsContext *ctx;
+    int src_w, src_h;
+    enum AVPixelFormat src_fmt;
+    int dst_w, dst_h;
+    enum AVPixelFormat dst_fmt;
+    int flags;
+    int64_t last_use;
+} ConvCacheEntry;
+
+// 格式转换上下文缓存，按 (源宽高格式, 目标宽高格式, flags) 查找，满时淘汰最久未用的。
+// 零初始化即可使用，不是线程安全的，每个线程各用一份
+typedef struct ConvCache {
+    ConvCacheEntry entries[CONV_CACHE_SIZE];
+    int64_t clock;
+    int64_t hits;
+    int64_t creates;
+} ConvCache;
+
+struct SwsContext *conv_cache_get(ConvCache *cache, int src_w, int src_h, enum AVPixelFormat src_fmt,
+                                  int dst_w, int dst_h, enum AVPixelFormat dst_fmt, int flags);
+
+// 按两帧各自的宽高与格式转换，dst 需已分配缓冲区
+int conv_cache_convert(ConvCache *cache, const AVFrame *src, AVFrame *dst, int flags);
+
+// 让 frame 拥有指定宽高格式的可写缓冲区，已满足时不重新分配
+int conv_frame_alloc(AVFrame *frame, int width, int height, enum AVPixelFormat format);
+
+void conv_cache_free(ConvCache *cache);
+
+// 把解码帧转成 RGB 逐帧导出为图片的公共状态，整个流中只创建一次，转换上下文逐帧复用。
+// 零初始化即可使用，写出方式（PNG 写线程池、小文件输出队列）由各导出工具自己持有
+typedef struct Exporter {
+    FrameSeq *seq;
+    ConvCache conv;
+    int64_t frames;     // 已导出的帧数，也是下一帧的输出编号
+} Exporter;
+
+void exporter_free(Exporter *ex);
+
+// 定期打印峰值常驻内存，长时间导出时它应保持不变
+void exporter_log_rss(const Exporter *ex);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FFMPEG_DEMO_CONV_TOOL_H
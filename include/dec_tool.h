@@ -0,0 +1,49 @@
+#ifndef FFMPEG_DEMO_DEC_TOOL_H
+#define FFMPEG_DEMO_DEC_TOOL_H
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 解码器参数
+typedef struct DecOptions {
+    int threads;        // --decode-threads，0 为自动
+    int thread_type;    // --decode-thread-type frame|slice|auto，auto 时两种都允许，由解码器选择
+} DecOptions;
+
+void dec_options_init(DecOptions *opts);
+
+// 解析一个参数，返回 1 表示已处理，0 表示不是解码器参数，负数为错误
+int dec_options_parse(DecOptions *opts, const char *name, const char *value);
+
+// 在 avcodec_open2 之前把线程参数写入解码器上下文
+void dec_options_apply(const DecOptions *opts, AVCodecContext *ctx);
+
+// avcodec_open2 之后打印实际生效的线程数与线程方式
+void dec_options_log(const AVCodecContext *ctx);
+
+// 打印解码帧数与吞吐，start 为 av_gettime_relative() 的起始值
+void dec_log_throughput(const AVCodecContext *ctx, int64_t frames, int64_t start);
+
+// 顺序解码一个视频文件中的视频流
+typedef struct DecInput DecInput;
+
+// 打开文件，找到视频流并按 opts 打开多线程解码器
+int dec_input_open(DecInput **in, const char *path, const DecOptions *opts);
+
+const AVStream *dec_input_stream(const DecInput *in);
+
+// 解码下一帧，pts 为流时间基下的源时间戳，缺失或不递增时接在上一帧之后；读完并取尽解码器后返回 AVERROR_EOF
+int dec_input_read(DecInput *in, AVFrame *frame);
+
+// 打印解码吞吐并关闭
+void dec_input_close(DecInput **in);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FFMPEG_DEMO_DEC_TOOL_H
@@ -0,0 +1,45 @@
+#ifndef FFMPEG_DEMO_ENC_TOOL_H
+#define FFMPEG_DEMO_ENC_TOOL_H
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/dict.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 编码器参数，命令行 --name value 与参数文件中的 name=value 一一对应
+typedef struct EncOptions {
+    int threads;            // --threads，默认 1，0 为自动
+    int thread_type;        // --thread-type frame|slice|auto
+    char *preset;           // --preset，未指定时 H.264 使用 slow
+    char *tune;             // --tune
+    char *crf;              // --crf，指定后默认不再设置码率
+    int64_t bit_rate;       // --bitrate，支持 k/M 后缀，-1 为默认
+    int gop_size;           // --gop
+    int max_b_frames;       // --bframes
+    AVRational framerate;   // --fps
+    AVDictionary *dict;     // --enc-opt key=value，原样传给 avcodec_open2
+} EncOptions;
+
+void enc_options_init(EncOptions *opts);
+
+void enc_options_free(EncOptions *opts);
+
+// 解析一个参数，返回 1 表示已处理，0 表示不是编码器参数，负数为错误
+int enc_options_parse(EncOptions *opts, const char *name, const char *value);
+
+// 读取参数文件，每行 name=value，# 开头为注释，文件内不能再出现 enc-options
+int enc_options_load(EncOptions *opts, const char *filename);
+
+// 把参数写入编码器上下文，dict 返回需要传给 avcodec_open2 的字典
+int enc_options_apply(const EncOptions *opts, AVCodecContext *ctx, AVDictionary **dict);
+
+// avcodec_open2 之后打印生效的参数，并提示未被使用的字典项
+void enc_options_log(const AVCodecContext *ctx, const AVDictionary *unused);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FFMPEG_DEMO_ENC_TOOL_H
@@ -1,8 +0,0 @@
-#ifndef FFMPEG_DEMO_FILE_TOOL_H
-#define FFMPEG_DEMO_FILE_TOOL_H
-
-#include <string>
-
-std::string readStringsFromFile(const char* filename);
-
-#endif //FFMPEG_DEMO_FILE_TOOL_H
@@ -0,0 +1,52 @@
+#ifndef FFMPEG_DEMO_FRAME_CACHE_TOOL_H
+#define FFMPEG_DEMO_FRAME_CACHE_TOOL_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// 按内容哈希缓存已解码并转换好的帧，LRU 淘汰，条目数与内存双重上限，可被多个线程同时使用。
+// 用于背景序列中重复出现的同一张图片，命中时直接拷贝像素，不再解码
+class FrameCache {
+public:
+    FrameCache(size_t max_entries, size_t max_bytes);
+
+    // 命中时把缓存的像素拷贝到 frame（宽高与像素格式须相同），返回 true
+    bool get(uint64_t key, AVFrame *frame);
+
+    // 复制 frame 的像素存入缓存，单帧超过内存上限时不缓存
+    void put(uint64_t key, const AVFrame *frame);
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+    size_t evictions() const { return evictions_; }
+    size_t entries() const { return entries_.size(); }
+    size_t bytes() const { return bytes_; }
+
+private:
+    struct Entry {
+        std::shared_ptr<const AVFrame> frame;
+        size_t bytes;
+        std::list<uint64_t>::iterator lru;
+    };
+
+    void evict();
+
+    std::mutex mutex_;
+    size_t max_entries_;
+    size_t max_bytes_;
+    size_t bytes_ = 0;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+    size_t evictions_ = 0;
+    std::list<uint64_t> lru_;
+    std::unordered_map<uint64_t, Entry> entries_;
+};
+
+#endif //FFMPEG_DEMO_FRAME_CACHE_TOOL_H
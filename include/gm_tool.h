@@ -3,8 +3,11 @@
 
 #include <Magick++/Image.h>
 
+#include "overlay_tool.h"
+
 extern "C" {
 #include <libavutil/frame.h>
+#include <libswscale/swscale.h>
 }
 
 #define PI 3.14159265358979323846
@@ -13,8 +16,21 @@ double to_radians(double degrees);
 
 void image_to_frame(Magick::Image *image, AVFrame *frame);
 
+// 直接从像素缓存转换到 frame 的像素格式（如 YUV420P），不经过 RGB24 中间帧。
+// 几何与 image_to_frame 一致：左上角对齐，按帧大小裁剪，不缩放
+int image_to_yuv_frame(Magick::Image *image, struct SwsContext **sws_ctx, AVFrame *frame);
+
+// 计算旋转后叠加图左上角相对于中心点的偏移
+void overlay_placement(int width, int height, double degrees, double *dx, double *dy);
+
 void composite_to_frame(Magick::Image *background, Magick::Image *overlay, int offsetX, int offsetY, const double degrees);
 
 void composite_to_frame_plus(Magick::Image *background, Magick::Image *overlay, int offsetX, int offsetY, const double degrees);
 
+// 将缓存的预乘叠加图直接混合到 RGB24 帧
+void composite_to_frame_plus(AVFrame *frame, const RotatedOverlay *overlay, int offsetX, int offsetY);
+
+// 将缓存的 YUVA444P 叠加图混合到 YUV420P 帧，只处理叠加图覆盖的区域
+void composite_to_yuv_frame(AVFrame *frame, const RotatedOverlay *overlay, int offsetX, int offsetY);
+
 #endif
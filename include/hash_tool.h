@@ -0,0 +1,38 @@
+#ifndef FFMPEG_DEMO_HASH_TOOL_H
+#define FFMPEG_DEMO_HASH_TOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libavutil/frame.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 64 位 xxHash（XXH64），每周期处理 32 字节，用于判断帧或文件内容是否相同
+typedef struct HashState {
+    uint64_t v[4];
+    uint64_t seed;
+    uint64_t total;
+    uint8_t buf[32];
+    int buffered;
+} HashState;
+
+void hash_init(HashState *s, uint64_t seed);
+
+void hash_update(HashState *s, const void *data, size_t size);
+
+uint64_t hash_final(const HashState *s);
+
+// 一次计算 data 的哈希
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed);
+
+// 计算帧像素的哈希，只计入每行的有效字节，不含行尾填充；宽高与像素格式也计入
+uint64_t hash_frame(const AVFrame *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FFMPEG_DEMO_HASH_TOOL_H
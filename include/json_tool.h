@@ -1,6 +1,8 @@
 #ifndef FFMPEG_DEMO_JSON_TOOL_H
 #define FFMPEG_DEMO_JSON_TOOL_H
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 struct Position {
@@ -9,6 +11,66 @@ struct Position {
     double degrees;
 };
 
-std::map<int, Position> parsePositions(const char* json);
+// 按帧号稠密存放的位置轨迹，位图标记哪些帧有位置，查找为 O(1)。
+// 数据在自己的数组中（由 JSON 解析填入），或直接指向 mmap 的二进制轨迹文件（见 track_tool）。
+// 加载完成后只读，可被多个线程同时使用
+class PositionTrack {
+public:
+    PositionTrack() = default;
+    ~PositionTrack();
+    PositionTrack(const PositionTrack &) = delete;
+    PositionTrack &operator=(const PositionTrack &) = delete;
+
+    // 第 frame 帧没有位置时返回 nullptr
+    const Position *find(int frame) const {
+        int64_t i = (int64_t) frame - first_;
+        if (i < 0 || i >= (int64_t) frames_ || !(present_[i >> 6] & (UINT64_C(1) << (i & 63)))) {
+            return nullptr;
+        }
+        return &records_[i];
+    }
+
+    // 只能用于自己持有数据的轨迹，frame 不能为负
+    void set(int frame, const Position &position);
+
+    // 有位置的帧数
+    size_t count() const { return count_; }
+    // 第一个有位置的帧号，数组从这一帧开始存放（加载过程中可能更小，shrink 后收紧）
+    int first() const { return first_; }
+    // 覆盖的帧数，即 [first, first + frames)
+    size_t frames() const { return frames_; }
+    // 数组与位图占用的内存，mmap 的轨迹为映射的大小，按需读入
+    size_t bytes() const;
+    bool mapped() const { return map_ != nullptr; }
+
+    // 加载结束后去掉首尾没有位置的帧并释放多余的容量
+    void shrink();
+
+    // 改为指向 mmap 的文件，记录与位图都在 map 中，析构时解除映射
+    void attach(void *map, size_t map_size, int first, size_t frames, size_t count,
+                const uint64_t *present, const Position *records);
+
+private:
+    void sync();
+
+    std::vector<Position> positions_;
+    std::vector<uint64_t> presence_;
+
+    // 查找使用的视图
+    const uint64_t *present_ = nullptr;
+    const Position *records_ = nullptr;
+    int first_ = 0;
+    size_t frames_ = 0;
+    size_t count_ = 0;
+    void *map_ = nullptr;
+    size_t map_size_ = 0;
+};
+
+// 以 SAX 方式分块读取位置文件 {"帧号": {"offsetX": x, "offsetY": y, "degrees": d}, ...}，
+// 直接填入 track，不读入整个文件也不构建 DOM。失败时返回 false
+bool loadPositions(const char *filename, PositionTrack *track);
+
+// 从内存中的 JSON 解析，格式同上
+bool parsePositions(const char *json, PositionTrack *track);
 
 #endif //FFMPEG_DEMO_JSON_TOOL_H
@@ -0,0 +1,43 @@
+#ifndef FFMPEG_DEMO_MUX_TOOL_H
+#define FFMPEG_DEMO_MUX_TOOL_H
+
+#include <libavcodec/avcodec.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 封装参数，容器格式由输出文件扩展名决定（mp4/mkv/ts 等）
+typedef struct MuxOptions {
+    int faststart;          // --faststart 1，mp4 的 moov 前置
+    int buffer_size;        // --mux-buffer-kb，AVIO 缓冲区大小
+    size_t queue_bytes;     // --mux-queue-mb，写线程队列上限
+} MuxOptions;
+
+typedef struct Muxer Muxer;
+
+void mux_options_init(MuxOptions *opts);
+
+// 解析一个参数，返回 1 表示已处理，0 表示不是封装参数，负数为错误
+int mux_options_parse(MuxOptions *opts, const char *name, const char *value);
+
+// 创建输出上下文，需在打开编码器之前调用以便设置全局头标志
+int mux_alloc(Muxer **mux, const char *filename, const MuxOptions *opts);
+
+// 容器需要全局头时返回 1，此时编码器应设置 AV_CODEC_FLAG_GLOBAL_HEADER
+int mux_need_global_header(const Muxer *mux);
+
+// 编码器打开后添加视频流、启动写线程并写入文件头
+int mux_start(Muxer *mux, const AVCodecContext *enc);
+
+// 写入一个编码器输出的包（时间基为编码器时间基），pkt 的引用被接管
+int mux_write(Muxer *mux, AVPacket *pkt);
+
+// 写入文件尾，等待写线程落盘并打印统计
+int mux_close(Muxer **mux);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FFMPEG_DEMO_MUX_TOOL_H
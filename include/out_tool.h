@@ -0,0 +1,74 @@
+#ifndef FFMPEG_DEMO_OUT_TOOL_H
+#define FFMPEG_DEMO_OUT_TOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    OUT_BACKEND_AUTO,       // 有 io_uring 时用 io_uring，否则用线程池
+    OUT_BACKEND_URING,
+    OUT_BACKEND_THREADS,
+};
+
+enum {
+    OUT_FSYNC_NONE,
+    OUT_FSYNC_DATA,         // 关闭前 fdatasync
+    OUT_FSYNC_FILE,         // 关闭前 fsync
+};
+
+// 小文件输出参数
+typedef struct OutOptions {
+    int backend;        // --out-backend auto|uring|threads
+    int depth;          // --out-depth，同时在途的文件数
+    int batch;          // --out-batch，io_uring 每次提交的文件数
+    int threads;        // --out-threads，线程池后端的线程数，0 为在调用线程中直接写
+    int fsync;          // --out-fsync none|data|file
+} OutOptions;
+
+// 一个待写入的文件，由 out_writer_get 取得，调用者填好文件头与数据后提交。
+// 写入时文件头与数据作为两段 iovec 一次写出
+typedef struct OutFile {
+    uint8_t header[64];
+    int header_size;
+    uint8_t *data;          // 至少 out_writer_get 时要求的大小，跨文件复用
+    size_t size;            // 数据的实际长度
+
+    // 以下由 out_tool 使用
+    int slot;
+    size_t capacity;
+    struct iovec iov[2];
+    char path[4096];
+    int pending;
+    int opened;             // io_uring 已打开到固定文件槽位
+    int failed;
+} OutFile;
+
+typedef struct OutWriter OutWriter;
+
+void out_options_init(OutOptions *opts);
+
+// 解析一个参数，返回 1 表示已处理，0 表示不是输出参数，负数为错误
+int out_options_parse(OutOptions *opts, const char *name, const char *value);
+
+// 创建输出队列，io_uring 不可用（编译时未启用或内核过旧）时自动退回线程池
+int out_writer_open(OutWriter **w, const OutOptions *opts);
+
+// 取一个空闲文件，数据缓冲区至少 size 字节；全部在途时等待，返回之前出现的错误
+int out_writer_get(OutWriter *w, size_t size, OutFile **file);
+
+// 提交文件写入 path，之后 file 归输出队列所有
+int out_writer_submit(OutWriter *w, OutFile *file, const char *path);
+
+// 等所有文件写完并释放，打印写成与失败的文件数，返回期间出现的第一个错误
+int out_writer_close(OutWriter **w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FFMPEG_DEMO_OUT_TOOL_H
@@ -0,0 +1,73 @@
+#ifndef FFMPEG_DEMO_OVERLAY_TOOL_H
+#define FFMPEG_DEMO_OVERLAY_TOOL_H
+
+#include <Magick++/Image.h>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// 旋转后的叠加图（预乘 RGBA，紧凑排列），dx/dy 为左上角相对于摆放中心点的偏移
+struct RotatedOverlay {
+    std::vector<uint8_t> rgba;
+    int width;
+    int height;
+    double degrees;
+    double dx;
+    double dy;
+    size_t bytes;
+    // YUV 域混合时使用的全分辨率 YUVA444P 版本，未启用时为空
+    AVFrame *yuva = nullptr;
+
+    ~RotatedOverlay() {
+        av_frame_free(&yuva);
+    }
+};
+
+// 按量化角度缓存旋转后的叠加图，LRU 淘汰，条目数与内存双重上限，可被多个线程同时使用
+class OverlayCache {
+public:
+    // precision 为角度量化步长（度），0 表示按精确角度缓存；yuv 为真时额外生成 YUVA444P 版本
+    OverlayCache(const Magick::Image &overlay, double precision, size_t max_entries, size_t max_bytes,
+                 bool yuv = false);
+
+    std::shared_ptr<const RotatedOverlay> get(double degrees);
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+    size_t evictions() const { return evictions_; }
+    size_t entries() const { return entries_.size(); }
+    size_t bytes() const { return bytes_; }
+
+private:
+    struct Entry {
+        std::shared_ptr<const RotatedOverlay> overlay;
+        std::list<int64_t>::iterator lru;
+    };
+
+    int64_t key(double degrees, double *quantized) const;
+    void evict();
+
+    std::shared_ptr<const RotatedOverlay> rotate(double quantized);
+
+    std::mutex mutex_;
+    Magick::Image overlay_;
+    double precision_;
+    size_t max_entries_;
+    size_t max_bytes_;
+    bool yuv_;
+    size_t bytes_ = 0;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+    size_t evictions_ = 0;
+    std::list<int64_t> lru_;
+    std::unordered_map<int64_t, Entry> entries_;
+};
+
+#endif //FFMPEG_DEMO_OVERLAY_TOOL_H
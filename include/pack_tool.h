@@ -0,0 +1,91 @@
+#ifndef FFMPEG_DEMO_PACK_TOOL_H
+#define FFMPEG_DEMO_PACK_TOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <libavutil/rational.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 把所有帧写进一个文件：
+//   y4m  YUV4MPEG2，按解码出的平面原样写入，不转 RGB
+//   raw  带索引的原始帧文件，文件头之后是按页对齐的定长帧，末尾是定长的帧表，可按帧号直接定位
+typedef struct PackOptions {
+    size_t buffer_size;     // --pack-buffer-mb，攒够这么多字节才写一次
+    AVRational frame_rate;  // 由调用者按输入流与选帧参数设置
+    AVRational time_base;   // 帧 pts 的时间基，记入 raw 的帧表
+} PackOptions;
+
+// 单文件中帧的布局
+typedef struct PackInfo {
+    int width;
+    int height;
+    enum AVPixelFormat format;
+    AVRational frame_rate;
+    AVRational time_base;   // 读出的帧 pts 的时间基，y4m 为帧率的倒数
+    int count;
+    size_t frame_size;      // 一帧像素的字节数，平面紧密排列
+} PackInfo;
+
+typedef struct PackWriter PackWriter;
+typedef struct PackReader PackReader;
+
+void pack_options_init(PackOptions *opts);
+
+// 解析一个参数，返回 1 表示已处理，0 表示不是单文件输出参数，负数为错误
+int pack_options_parse(PackOptions *opts, const char *name, const char *value);
+
+// type 是支持的单文件格式（y4m/raw）时返回 1
+int pack_type_supported(const char *type);
+
+int pack_writer_open(PackWriter **w, const char *type, const char *path, const PackOptions *opts);
+
+// 第一次调用时按 frame 定下整个文件的宽高与像素格式（y4m 不支持的格式换成 YUV420P），
+// 之后的帧与之不同时由调用者先转换
+int pack_writer_layout(PackWriter *w, const AVFrame *frame, int *width, int *height, enum AVPixelFormat *format);
+
+// 追加一帧，帧的宽高与格式必须与 pack_writer_layout 一致
+int pack_writer_write(PackWriter *w, const AVFrame *frame);
+
+// 写出剩余数据与帧表，打印统计，返回期间出现的第一个错误
+int pack_writer_close(PackWriter **w);
+
+// path 是 y4m 或 raw 单文件时返回 1，用于区分输入是单文件还是图片序列模板
+int pack_probe(const char *path);
+
+int pack_reader_open(PackReader **r, const char *path);
+
+const PackInfo *pack_reader_info(const PackReader *r);
+
+// 读第 index 帧到 frame，一次 pread 读入整帧，缓冲区来自缓冲池。可在多个线程中同时调用
+int pack_reader_read(PackReader *r, int index, AVFrame *frame);
+
+void pack_reader_close(PackReader **r);
+
+// 顺序读取的输入流：标准输入、命名管道或普通文件中的 y4m，或不带文件头的原始帧
+typedef struct PackStream PackStream;
+
+// path 为 - 时读标准输入。流以 YUV4MPEG2 开头时按其文件头读取，
+// 否则按 width、height 与 format 读原始帧，此时三者必须给出
+int pack_stream_open(PackStream **s, const char *path, int width, int height, enum AVPixelFormat format);
+
+// 流的帧数未知，count 为 0
+const PackInfo *pack_stream_info(const PackStream *s);
+
+// 读下一帧到 frame，帧的像素直接读进缓冲池中的缓冲区；流结束时返回 AVERROR_EOF。
+// 不是线程安全的，多个线程读取时由调用者加锁
+int pack_stream_read(PackStream *s, AVFrame *frame);
+
+// 打印读取统计并关闭
+void pack_stream_close(PackStream **s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FFMPEG_DEMO_PACK_TOOL_H
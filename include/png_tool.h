@@ -0,0 +1,46 @@
+#ifndef FFMPEG_DEMO_PNG_TOOL_H
+#define FFMPEG_DEMO_PNG_TOOL_H
+
+#include <libavutil/frame.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// PNG 压缩参数，-1 表示沿用 libpng 的默认值
+typedef struct PngOptions {
+    int level;          // --png-level 0-9，zlib 压缩级别
+    int strategy;       // --png-strategy default|filtered|huffman|rle|fixed
+    int filter;         // --png-filter none|sub|up|avg|paeth|all
+    int threads;        // --png-threads，写 PNG 的线程数，0 为在解码线程中直接写
+    int queue;          // --png-queue，在途帧数上限，0 为线程数的两倍
+} PngOptions;
+
+typedef struct PngWriter PngWriter;
+
+void png_options_init(PngOptions *opts);
+
+// 解析一个参数，返回 1 表示已处理，0 表示不是 PNG 参数，负数为错误。
+// --png-preset fast|small 一次设置级别、策略与滤波
+int png_options_parse(PngOptions *opts, const char *name, const char *value);
+
+// 把 RGB24 帧写成 PNG 文件，按 linesize 逐行写入
+int png_write_frame(const char *filename, const AVFrame *frame, const PngOptions *opts);
+
+// 启动写线程，帧缓冲区预先分配 queue 个并循环复用
+int png_writer_start(PngWriter **w, const PngOptions *opts);
+
+// 取一个空闲帧，全部在途时等待；调用者自行分配或复用其缓冲区
+int png_writer_get(PngWriter *w, AVFrame **frame);
+
+// 提交取得的帧写入 filename，帧归写线程所有，写完后回到空闲列表
+int png_writer_submit(PngWriter *w, AVFrame *frame, const char *filename);
+
+// 等待所有帧写完并退出写线程，返回期间出现的第一个错误
+int png_writer_close(PngWriter **w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FFMPEG_DEMO_PNG_TOOL_H
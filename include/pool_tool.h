@@ -0,0 +1,30 @@
+#ifndef FFMPEG_DEMO_POOL_TOOL_H
+#define FFMPEG_DEMO_POOL_TOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 有序工作池：多个线程按序号领取任务并行执行，消费者按序号依次取结果。
+// 同时在途的任务不超过 depth 个，第 index 个任务使用第 index % depth 个槽位。
+typedef struct JobPool JobPool;
+
+// 在工作线程中执行第 index 个任务，结果写入调用者自己管理的第 slot 个槽位，返回负数使整个池出错
+typedef int (*PoolJob)(void *opaque, int worker, int index, int slot);
+
+int pool_start(JobPool **pool, int workers, int depth, int total, PoolJob job, void *opaque);
+
+// 等待第 index 个任务完成，返回其槽位，出错时返回任务的错误码
+int pool_take(JobPool *pool, int index);
+
+// 第 index 个任务的结果用完，槽位可以给后面的任务使用
+void pool_release(JobPool *pool, int index);
+
+// 中止并等待所有工作线程退出，打印等待统计
+void pool_stop(JobPool **pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FFMPEG_DEMO_POOL_TOOL_H
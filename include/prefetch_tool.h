@@ -0,0 +1,49 @@
+#ifndef FFMPEG_DEMO_PREFETCH_TOOL_H
+#define FFMPEG_DEMO_PREFETCH_TOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libavformat/avio.h>
+
+#include "seq_tool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Prefetcher Prefetcher;
+
+// 预读好的一帧文件内容，mmap 映射，只读
+typedef struct PrefetchBuf {
+    int index;
+    const uint8_t *data;
+    size_t size;
+    Prefetcher *owner;
+} PrefetchBuf;
+
+// 启动预读线程，按序号提前读取最多 depth 帧
+int prefetch_start(Prefetcher **pf, const FrameSeq *seq, int depth);
+
+// 取第 index 帧，未读完时等待，可在多个线程中调用
+int prefetch_get(Prefetcher *pf, int index, PrefetchBuf **buf);
+
+// 用完后归还，预读线程才能复用该位置
+void prefetch_release(PrefetchBuf *buf);
+
+// 唤醒所有等待者并让 prefetch_get 返回错误，用于出错退出
+void prefetch_abort(Prefetcher *pf);
+
+// 停止预读线程、释放映射并打印命中与等待统计
+void prefetch_stop(Prefetcher **pf);
+
+// 以内存中的文件内容创建 AVIOContext，供 avformat_open_input 使用
+AVIOContext *prefetch_avio_alloc(const uint8_t *data, size_t size);
+
+void prefetch_avio_free(AVIOContext **pb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FFMPEG_DEMO_PREFETCH_TOOL_H
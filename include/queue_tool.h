@@ -0,0 +1,99 @@
+#ifndef FFMPEG_DEMO_QUEUE_TOOL_H
+#define FFMPEG_DEMO_QUEUE_TOOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// 按序号存取的有界无锁环形队列，槽位元素预先分配并循环复用。
+// 序号 n 固定落在 n % depth 号槽位：生产者写完 n 后消费者才能取 n，
+// 消费者取完 n 后生产者才能写 n + depth，因此输出天然保持序号顺序。
+template<typename T>
+class OrderedRing {
+public:
+    explicit OrderedRing(size_t depth) : depth_(depth), slots_(new Slot[depth]) {
+        for (size_t i = 0; i < depth; i++) {
+            slots_[i].seq.store(i * 2, std::memory_order_relaxed);
+        }
+    }
+
+    OrderedRing(const OrderedRing &) = delete;
+    OrderedRing &operator=(const OrderedRing &) = delete;
+
+    size_t depth() const {
+        return depth_;
+    }
+
+    // 遍历所有槽位元素，用于预分配
+    template<typename F>
+    void for_each(F fn) {
+        for (size_t i = 0; i < depth_; i++) {
+            fn(slots_[i].item);
+        }
+    }
+
+    // 等待序号 n 的槽位空闲，返回可写入的元素；队列被中止时返回 nullptr
+    T *begin_put(uint64_t n) {
+        Slot &slot = slots_[n % depth_];
+        return wait(slot, n * 2) ? &slot.item : nullptr;
+    }
+
+    bool end_put(uint64_t n) {
+        return advance(slots_[n % depth_], n * 2, n * 2 + 1);
+    }
+
+    // 等待序号 n 的元素写入完成，返回可读取的元素；队列被中止时返回 nullptr
+    T *begin_take(uint64_t n) {
+        Slot &slot = slots_[n % depth_];
+        return wait(slot, n * 2 + 1) ? &slot.item : nullptr;
+    }
+
+    bool end_take(uint64_t n) {
+        return advance(slots_[n % depth_], n * 2 + 1, (n + depth_) * 2);
+    }
+
+    // 唤醒所有等待者并使之后的操作全部失败
+    void abort() {
+        for (size_t i = 0; i < depth_; i++) {
+            slots_[i].seq.store(ABORTED, std::memory_order_release);
+            slots_[i].seq.notify_all();
+        }
+    }
+
+private:
+    static constexpr uint64_t ABORTED = UINT64_MAX;
+
+    struct Slot {
+        std::atomic<uint64_t> seq;
+        T item;
+    };
+
+    static bool wait(Slot &slot, uint64_t target) {
+        for (int spin = 0;; spin++) {
+            uint64_t seq = slot.seq.load(std::memory_order_acquire);
+            if (seq == target) {
+                return true;
+            }
+            if (seq == ABORTED) {
+                return false;
+            }
+            // 短暂自旋后挂起，直到序号变化
+            if (spin >= 64) {
+                slot.seq.wait(seq, std::memory_order_acquire);
+            }
+        }
+    }
+
+    static bool advance(Slot &slot, uint64_t expected, uint64_t next) {
+        if (!slot.seq.compare_exchange_strong(expected, next, std::memory_order_acq_rel)) {
+            return false;
+        }
+        slot.seq.notify_all();
+        return true;
+    }
+
+    size_t depth_;
+    std::unique_ptr<Slot[]> slots_;
+};
+
+#endif //FFMPEG_DEMO_QUEUE_TOOL_H
@@ -0,0 +1,75 @@
+#ifndef FFMPEG_DEMO_SCENE_TOOL_H
+#define FFMPEG_DEMO_SCENE_TOOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "json_tool.h"
+#include "overlay_tool.h"
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// 帧中被叠加改动的矩形区域，已裁剪到帧内
+struct SceneRect {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// 多层叠加场景：每层一张叠加图与一条位置轨迹，按添加顺序由下往上叠加。
+// 同一张图片被多层使用时只解码一次，共用一个旋转缓存。
+// 每帧只在各层的包围盒内混合，开销与被覆盖的面积成正比，与层数乘帧大小无关。
+// 加载完成后可被多个线程同时使用
+class Scene {
+public:
+    // 参数同 OverlayCache，max_bytes 由所有图片平分
+    Scene(double precision, size_t max_entries, size_t max_bytes, bool yuv);
+
+    // 添加一层并加载其位置轨迹，失败时返回 false
+    bool addLayer(const char *image, const char *track);
+
+    // 从场景文件添加多层，每行 "叠加图 位置文件"，# 开头为注释
+    bool addLayers(const char *scene_file);
+
+    // 所有层添加完后解码各图片并创建旋转缓存，图片读取失败时抛出 Magick 异常
+    void open();
+
+    // 把第 index 帧的所有层叠加到 frame（RGB24，或 YUV 域混合时为 YUV420P），
+    // dirty 返回合并后互不重叠的改动区域，YUV 域按色度对齐到偶数坐标。返回叠加的层数
+    int render(AVFrame *frame, int index, std::vector<SceneRect> *dirty);
+
+    size_t layers() const { return layers_.size(); }
+
+    // 打印各层、改动面积与旋转缓存统计
+    void log() const;
+
+private:
+    struct Layer {
+        std::string image;
+        PositionTrack track;
+        OverlayCache *cache = nullptr;
+    };
+
+    double precision_;
+    size_t max_entries_;
+    size_t max_bytes_;
+    bool yuv_;
+    std::vector<std::unique_ptr<Layer>> layers_;
+    // 按图片路径去重
+    std::map<std::string, std::unique_ptr<OverlayCache>> caches_;
+
+    std::atomic<uint64_t> frames_{0};
+    std::atomic<uint64_t> composited_{0};
+    std::atomic<uint64_t> layer_pixels_{0};
+    std::atomic<uint64_t> dirty_pixels_{0};
+    std::atomic<uint64_t> frame_pixels_{0};
+};
+
+#endif //FFMPEG_DEMO_SCENE_TOOL_H
@@ -0,0 +1,63 @@
+#ifndef FFMPEG_DEMO_SELECT_TOOL_H
+#define FFMPEG_DEMO_SELECT_TOOL_H
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 选帧参数，时间为相对文件开头的秒数，也可写作 [HH:]MM:SS[.m...]
+typedef struct SelectOptions {
+    int64_t start;      // --start，微秒
+    int64_t end;        // --end，微秒，-1 为到结尾
+    int every;          // --every N，每 N 帧取一帧
+    double fps;         // --fps R，每秒取 R 帧，0 为不限
+    int keyframes;      // --keyframes 1，只解码关键帧
+    int64_t seek_gap;   // --seek-gap，下一个要取的帧比当前远过这么多微秒时直接 seek
+} SelectOptions;
+
+// 选帧状态，零初始化后由 select_start 设置
+typedef struct FrameSelect {
+    SelectOptions opts;
+    AVFormatContext *fmt_ctx;
+    AVCodecContext *ctx;
+    AVStream *st;
+    int64_t origin;     // 流的起始时间，流时间基
+    int64_t step;       // 两个被选帧之间的间隔，微秒，0 为逐帧
+    int64_t next;       // 下一个要取的时间点，微秒
+    int64_t half_frame; // 半帧时长，微秒，用于时间点的容差
+    int64_t counter;    // 帧率未知时按帧计数实现 --every
+    int seek_pending;
+
+    // 统计
+    int64_t selected;
+    int64_t dropped_packets;
+    int64_t nonref_packets;
+    int64_t seeks;
+} FrameSelect;
+
+void select_options_init(SelectOptions *opts);
+
+// 解析一个参数，返回 1 表示已处理，0 表示不是选帧参数，负数为错误
+int select_options_parse(SelectOptions *opts, const char *name, const char *value);
+
+// 在解码器打开后调用：设置关键帧模式并 seek 到 --start 之前最近的关键帧
+int select_start(FrameSelect *sel, const SelectOptions *opts, AVFormatContext *fmt_ctx, int stream,
+                 AVCodecContext *ctx);
+
+// 在送入解码器之前检查包：返回 1 送解码，0 丢弃，AVERROR_EOF 表示之后不会再有要取的帧。
+// 只送解码而不会被选中的包会让解码器跳过其中的非参考帧
+int select_packet(FrameSelect *sel, AVPacket *pkt);
+
+// 检查解码出的帧：返回 1 输出，0 丢弃，AVERROR_EOF 表示已超出 --end
+int select_frame(FrameSelect *sel, const AVFrame *frame);
+
+void select_log(const FrameSelect *sel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FFMPEG_DEMO_SELECT_TOOL_H
@@ -0,0 +1,49 @@
+#ifndef FFMPEG_DEMO_SEQ_TOOL_H
+#define FFMPEG_DEMO_SEQ_TOOL_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 帧序列参数，文件名模板形如 dir/%06d.png，只允许一个 %d（可带 0 填充与宽度）
+typedef struct SeqOptions {
+    int start;      // --start-number，第一帧编号，默认 1
+    int end;        // --end-number，最后一帧编号，-1 为不限
+    int step;       // --step，编号间隔
+    int shard;      // --shard N，每 N 帧一个子目录，子目录名为该组第一帧的编号，0 为不分目录
+} SeqOptions;
+
+typedef struct FrameSeq FrameSeq;
+
+void seq_options_init(SeqOptions *opts);
+
+// 解析一个参数，返回 1 表示已处理，0 表示不是序列参数，负数为错误
+int seq_options_parse(SeqOptions *opts, const char *name, const char *value);
+
+// 解析文件名模板
+int seq_open(FrameSeq **seq, const char *pattern, const SeqOptions *opts);
+
+void seq_free(FrameSeq **seq);
+
+// 每个目录只读取一次，从 start 开始按 step 取连续存在的帧，遇到缺失即停止，返回帧数
+int seq_scan(FrameSeq *seq);
+
+// seq_scan 得到的帧数
+int seq_count(const FrameSeq *seq);
+
+// 第 index 帧（从 0 开始）的编号
+int seq_number(const FrameSeq *seq, int index);
+
+// 第 index 帧的路径，可在多个线程中同时调用
+int seq_path(const FrameSeq *seq, int index, char *buf, size_t size);
+
+// 输出用的路径，需要时创建分片子目录，只能在一个线程中调用
+int seq_output_path(FrameSeq *seq, int index, char *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FFMPEG_DEMO_SEQ_TOOL_H
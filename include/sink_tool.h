@@ -0,0 +1,38 @@
+#ifndef FFMPEG_DEMO_SINK_TOOL_H
+#define FFMPEG_DEMO_SINK_TOOL_H
+
+#include <libavutil/frame.h>
+
+#include "out_tool.h"
+#include "pack_tool.h"
+#include "png_tool.h"
+#include "seq_tool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 帧输出端，每个输出端有自己的线程、文件名模板与格式转换。
+// 解码出的帧以引用方式分发给所有输出端，慢的输出端只在自己的队列满时才让解码等待
+typedef struct FrameSink FrameSink;
+
+// type 是支持的输出格式时返回 1
+int sink_type_supported(const char *type);
+
+// 创建 type（pgm/ppm/bmp/png/y4m/raw）类型的输出端并启动线程，queue 为缓冲的帧数上限。
+// png 由 PNG 写线程池输出，y4m 与 raw 把所有帧写进 pattern 指定的一个文件，其余格式通过 out_tool 批量写小文件
+int sink_open(FrameSink **sink, const char *type, const char *pattern,
+              const SeqOptions *seq_opts, const PngOptions *png_opts, const OutOptions *out_opts,
+              const PackOptions *pack_opts, int queue);
+
+// 把第 index 帧交给输出端，只增加引用不拷贝；队列已满时等待，返回输出端之前出现的错误
+int sink_push(FrameSink *sink, const AVFrame *frame, int index);
+
+// 写完队列中剩余的帧后退出线程并打印统计，返回期间出现的第一个错误
+int sink_close(FrameSink **sink);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FFMPEG_DEMO_SINK_TOOL_H
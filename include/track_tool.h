@@ -0,0 +1,39 @@
+#ifndef FFMPEG_DEMO_TRACK_TOOL_H
+#define FFMPEG_DEMO_TRACK_TOOL_H
+
+#include <cstdint>
+
+#include "json_tool.h"
+
+// 二进制位置轨迹（.ptrk），小端，mmap 后直接查找，不做任何解析：
+//   0 文件头 128 字节：magic "FXPTRK01"、版本、每条记录的长度、帧范围 [first, first + frames)、
+//     有位置的帧数、生成时 JSON 文件的大小、修改时间与内容哈希
+//   128 位图，frames 位，按 64 位字存放
+//   之后按 64 字节对齐：frames 条定长记录，即 Position（16 字节）
+struct TrackSource {
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t hash;      // 内容的 FNV-1a 64 位哈希，0 表示未计算
+};
+
+// 读取文件的大小与修改时间，hash 为 true 时同时计算内容哈希
+bool trackSourceStat(const char *path, TrackSource *source, bool hash);
+
+// path 是二进制轨迹时返回 true
+bool isTrackFile(const char *path);
+
+// 把轨迹写成二进制文件（先写 path.XXXXXX 临时文件再改名）
+bool saveTrack(const char *path, const PositionTrack &track, const TrackSource &source);
+
+// 只读取二进制轨迹的文件头，得到生成时的 JSON 信息
+bool readTrackSource(const char *path, TrackSource *source);
+
+// mmap 二进制轨迹，记录在查找时按页读入
+bool openTrack(const char *path, PositionTrack *track);
+
+// 加载位置文件：二进制轨迹直接 mmap；JSON 优先使用旁边的 <path>.ptrk，
+// 其记录的大小与修改时间与 JSON 一致时直接使用，修改时间不同但内容哈希相同时也使用，
+// 否则解析 JSON 并重新生成。how 返回实际的加载方式，用于日志
+bool loadTrackCached(const char *path, PositionTrack *track, const char **how);
+
+#endif //FFMPEG_DEMO_TRACK_TOOL_H
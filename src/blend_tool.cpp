@@ -0,0 +1,274 @@
+#include "blend_tool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLEND_X86 1
+#endif
+
+extern "C" {
+#include <libavutil/log.h>
+}
+
+// 精确的 t / 255 四舍五入，t <= 255 * 255
+static inline int div255(int t) {
+    t += 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+static void blend_row_c(uint8_t *dst, const uint8_t *src, int n) {
+    for (int i = 0; i < n; i++, dst += 3, src += 4) {
+        int inv = 255 - src[3];
+        dst[0] = std::min(255, src[0] + div255(dst[0] * inv));
+        dst[1] = std::min(255, src[1] + div255(dst[1] * inv));
+        dst[2] = std::min(255, src[2] + div255(dst[2] * inv));
+    }
+}
+
+#ifdef BLEND_X86
+// 16 位通道上计算 div255(d * inv)
+__attribute__((target("sse4.1")))
+static inline __m128i mul_div255_sse41(__m128i d, __m128i inv) {
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(d, inv), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("sse4.1")))
+static void blend_row_sse41(uint8_t *dst, const uint8_t *src, int n) {
+    // 4 个 RGBA 像素打包成 12 字节 RGB，末尾 4 个通道 alpha 为 0 保持 dst 不变
+    const __m128i rgb_mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m128i alpha_mask = _mm_setr_epi8(3, 3, 3, 7, 7, 7, 11, 11, 11, 15, 15, 15, -1, -1, -1, -1);
+    const __m128i c255 = _mm_set1_epi8((char) 255);
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    // 每次读写 dst 16 字节，需保证不越过本行剩余像素
+    for (; n - i >= 6; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *) (src + i * 4));
+        __m128i d = _mm_loadu_si128((const __m128i *) (dst + i * 3));
+        __m128i rgb = _mm_shuffle_epi8(s, rgb_mask);
+        __m128i inv = _mm_sub_epi8(c255, _mm_shuffle_epi8(s, alpha_mask));
+
+        __m128i d_lo = _mm_cvtepu8_epi16(d);
+        __m128i d_hi = _mm_unpackhi_epi8(d, zero);
+        __m128i inv_lo = _mm_cvtepu8_epi16(inv);
+        __m128i inv_hi = _mm_unpackhi_epi8(inv, zero);
+        __m128i lo = mul_div255_sse41(d_lo, inv_lo);
+        __m128i hi = mul_div255_sse41(d_hi, inv_hi);
+
+        _mm_storeu_si128((__m128i *) (dst + i * 3), _mm_adds_epu8(rgb, _mm_packus_epi16(lo, hi)));
+    }
+    blend_row_c(dst + i * 3, src + i * 4, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i mul_div255_avx2(__m256i d, __m256i inv) {
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(d, inv), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+static void blend_row_avx2(uint8_t *dst, const uint8_t *src, int n) {
+    // 每个 128 位通道处理 4 个像素，dst 按 +0 与 +12 字节两段读写
+    const __m256i rgb_mask = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                              0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m256i alpha_mask = _mm256_setr_epi8(3, 3, 3, 7, 7, 7, 11, 11, 11, 15, 15, 15, -1, -1, -1, -1,
+                                                3, 3, 3, 7, 7, 7, 11, 11, 11, 15, 15, 15, -1, -1, -1, -1);
+    const __m256i c255 = _mm256_set1_epi8((char) 255);
+    const __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    for (; n - i >= 10; i += 8) {
+        uint8_t *d0 = dst + i * 3;
+        __m256i s = _mm256_loadu_si256((const __m256i *) (src + i * 4));
+        __m256i d = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) d0)),
+                                            _mm_loadu_si128((const __m128i *) (d0 + 12)), 1);
+        __m256i rgb = _mm256_shuffle_epi8(s, rgb_mask);
+        __m256i inv = _mm256_sub_epi8(c255, _mm256_shuffle_epi8(s, alpha_mask));
+
+        __m256i lo = mul_div255_avx2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(inv, zero));
+        __m256i hi = mul_div255_avx2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(inv, zero));
+        __m256i out = _mm256_adds_epu8(rgb, _mm256_packus_epi16(lo, hi));
+
+        // 先写低段再写高段，高段覆盖低段末尾未改动的 4 字节
+        _mm_storeu_si128((__m128i *) d0, _mm256_castsi256_si128(out));
+        _mm_storeu_si128((__m128i *) (d0 + 12), _mm256_extracti128_si256(out, 1));
+    }
+    blend_row_c(dst + i * 3, src + i * 4, n - i);
+}
+#endif
+
+struct BlendKernel {
+    const char *name;
+    blend_row_fn fn;
+    bool (*supported)();
+};
+
+static bool cpu_any() {
+    return true;
+}
+
+#ifdef BLEND_X86
+static bool cpu_sse41() {
+    return __builtin_cpu_supports("sse4.1");
+}
+
+static bool cpu_avx2() {
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+// 按优先级从低到高排列
+static const BlendKernel kernels[] = {
+        {"scalar", blend_row_c,     cpu_any},
+#ifdef BLEND_X86
+        {"sse4.1", blend_row_sse41, cpu_sse41},
+        {"avx2",   blend_row_avx2,  cpu_avx2},
+#endif
+};
+
+static const int nb_kernels = sizeof(kernels) / sizeof(kernels[0]);
+static const BlendKernel *current = &kernels[0];
+static bool kernel_ok[sizeof(kernels) / sizeof(kernels[0])];
+
+int blend_self_check() {
+    std::mt19937 rng(20240601);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<uint8_t> src(67 * 4), ref(67 * 3 + 16), out(67 * 3 + 16);
+    int failed = 0;
+
+    for (int k = 0; k < nb_kernels; k++) {
+        kernel_ok[k] = kernels[k].supported();
+    }
+    for (int n = 1; n <= 67; n++) {
+        for (int p = 0; p < n; p++) {
+            // 生成合法的预乘像素，覆盖全透明与全不透明
+            int a = p % 7 == 0 ? 0 : p % 7 == 1 ? 255 : byte(rng);
+            for (int c = 0; c < 3; c++) {
+                src[p * 4 + c] = div255(byte(rng) * a);
+            }
+            src[p * 4 + 3] = a;
+        }
+        for (auto &v: ref) {
+            v = byte(rng);
+        }
+        std::vector<uint8_t> base = ref;
+        blend_row_c(ref.data(), src.data(), n);
+        for (int k = 1; k < nb_kernels; k++) {
+            if (!kernel_ok[k]) {
+                continue;
+            }
+            out = base;
+            kernels[k].fn(out.data(), src.data(), n);
+            if (out != ref) {
+                av_log(NULL, AV_LOG_ERROR, "blend kernel %s differs from scalar at width %d\n", kernels[k].name, n);
+                kernel_ok[k] = false;
+                failed++;
+            }
+        }
+    }
+    return failed;
+}
+
+int blend_init(const char *name) {
+    blend_self_check();
+    current = &kernels[0];
+    for (int k = 0; k < nb_kernels; k++) {
+        if (!kernel_ok[k]) {
+            continue;
+        }
+        if (!name || strcmp(name, "auto") == 0) {
+            current = &kernels[k];
+        } else if (strcmp(name, kernels[k].name) == 0) {
+            current = &kernels[k];
+            return 0;
+        }
+    }
+    if (name && strcmp(name, "auto") != 0) {
+        av_log(NULL, AV_LOG_ERROR, "blend kernel %s is not available\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+const char *blend_kernel_name() {
+    return current->name;
+}
+
+void blend_premultiply(uint8_t *rgba, size_t pixels) {
+    for (size_t i = 0; i < pixels; i++, rgba += 4) {
+        int a = rgba[3];
+        rgba[0] = div255(rgba[0] * a);
+        rgba[1] = div255(rgba[1] * a);
+        rgba[2] = div255(rgba[2] * a);
+    }
+}
+
+void blend_yuva_to_yuv420p(AVFrame *frame, const AVFrame *overlay, int x, int y) {
+    int x0 = std::max(x, 0);
+    int y0 = std::max(y, 0);
+    int x1 = std::min(x + overlay->width, frame->width);
+    int y1 = std::min(y + overlay->height, frame->height);
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    // 亮度逐像素混合
+    for (int yy = y0; yy < y1; yy++) {
+        uint8_t *dst = frame->data[0] + yy * frame->linesize[0];
+        const uint8_t *oy = overlay->data[0] + (yy - y) * overlay->linesize[0] - x;
+        const uint8_t *oa = overlay->data[3] + (yy - y) * overlay->linesize[3] - x;
+        for (int xx = x0; xx < x1; xx++) {
+            int a = oa[xx];
+            dst[xx] = div255(oy[xx] * a + dst[xx] * (255 - a));
+        }
+    }
+
+    // 色度：每个色度样本对应 2x2 亮度块，块内不在叠加图上的位置视为透明
+    int cx1 = (x1 + 1) >> 1;
+    int cy1 = (y1 + 1) >> 1;
+    for (int cy = y0 >> 1; cy < cy1; cy++) {
+        uint8_t *du = frame->data[1] + cy * frame->linesize[1];
+        uint8_t *dv = frame->data[2] + cy * frame->linesize[2];
+        for (int cx = x0 >> 1; cx < cx1; cx++) {
+            int wsum = 0, usum = 0, vsum = 0;
+            for (int ly = cy * 2; ly < cy * 2 + 2; ly++) {
+                if (ly < y0 || ly >= y1) {
+                    continue;
+                }
+                const uint8_t *ou = overlay->data[1] + (ly - y) * overlay->linesize[1] - x;
+                const uint8_t *ov = overlay->data[2] + (ly - y) * overlay->linesize[2] - x;
+                const uint8_t *oa = overlay->data[3] + (ly - y) * overlay->linesize[3] - x;
+                for (int lx = cx * 2; lx < cx * 2 + 2; lx++) {
+                    if (lx < x0 || lx >= x1) {
+                        continue;
+                    }
+                    wsum += oa[lx];
+                    usum += oa[lx] * ou[lx];
+                    vsum += oa[lx] * ov[lx];
+                }
+            }
+            if (wsum == 0) {
+                continue;
+            }
+            du[cx] = (usum + (4 * 255 - wsum) * du[cx] + 510) / 1020;
+            dv[cx] = (vsum + (4 * 255 - wsum) * dv[cx] + 510) / 1020;
+        }
+    }
+}
+
+void blend_rgba_to_rgb24(AVFrame *frame, const uint8_t *rgba, int width, int height, int stride, int x, int y) {
+    int x0 = std::max(x, 0);
+    int y0 = std::max(y, 0);
+    int x1 = std::min(x + width, frame->width);
+    int y1 = std::min(y + height, frame->height);
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+    for (int yy = y0; yy < y1; yy++) {
+        current->fn(frame->data[0] + yy * frame->linesize[0] + x0 * 3,
+                    rgba + (yy - y) * stride + (x0 - x) * 4, x1 - x0);
+    }
+}
@@ -0,0 +1,99 @@
+#include "conv_tool.h"
+
+#include <errno.h>
+#include <sys/resource.h>
+
+#include <libavutil/error.h>
+#include <libavutil/log.h>
+#include <libswscale/swscale.h>
+
+struct SwsContext *conv_cache_get(ConvCache *cache, int src_w, int src_h, enum AVPixelFormat src_fmt,
+                                  int dst_w, int dst_h, enum AVPixelFormat dst_fmt, int flags) {
+    ConvCacheEntry *victim = &cache->entries[0];
+    cache->clock++;
+    for (int k = 0; k < CONV_CACHE_SIZE; k++) {
+        ConvCacheEntry *e = &cache->entries[k];
+        if (e->ctx && e->src_w == src_w && e->src_h == src_h && e->src_fmt == src_fmt
+            && e->dst_w == dst_w && e->dst_h == dst_h && e->dst_fmt == dst_fmt && e->flags == flags) {
+            e->last_use = cache->clock;
+            cache->hits++;
+            return e->ctx;
+        }
+        // 优先使用空位，否则淘汰最久未用的
+        if (victim->ctx && (!e->ctx || e->last_use < victim->last_use)) {
+            victim = e;
+        }
+    }
+
+    // 流中途分辨率或格式变化时才会走到这里
+    struct SwsContext *ctx = sws_getContext(src_w, src_h, src_fmt, dst_w, dst_h, dst_fmt,
+                                            flags, NULL, NULL, NULL);
+    if (!ctx) {
+        av_log(NULL, AV_LOG_ERROR, "Could not initialize the conversion context\n");
+        return NULL;
+    }
+    if (cache->creates > 0) {
+        av_log(NULL, AV_LOG_INFO, "conversion context rebuilt for %dx%d -> %dx%d\n", src_w, src_h, dst_w, dst_h);
+    }
+    sws_freeContext(victim->ctx);
+    victim->ctx = ctx;
+    victim->src_w = src_w;
+    victim->src_h = src_h;
+    victim->src_fmt = src_fmt;
+    victim->dst_w = dst_w;
+    victim->dst_h = dst_h;
+    victim->dst_fmt = dst_fmt;
+    victim->flags = flags;
+    victim->last_use = cache->clock;
+    cache->creates++;
+    return ctx;
+}
+
+int conv_cache_convert(ConvCache *cache, const AVFrame *src, AVFrame *dst, int flags) {
+    struct SwsContext *ctx = conv_cache_get(cache, src->width, src->height, src->format,
+                                            dst->width, dst->height, dst->format, flags);
+    if (!ctx) {
+        return AVERROR(EINVAL);
+    }
+    sws_scale(ctx, (const uint8_t * const *)src->data, src->linesize, 0, src->height,
+              dst->data, dst->linesize);
+    return 0;
+}
+
+int conv_frame_alloc(AVFrame *frame, int width, int height, enum AVPixelFormat format) {
+    if (frame->buf[0] && frame->width == width && frame->height == height && frame->format == format
+        && av_frame_is_writable(frame)) {
+        return 0;
+    }
+    // 尺寸变化或仍被别处引用时换一块新缓冲区，不拷贝旧内容
+    av_frame_unref(frame);
+    frame->width = width;
+    frame->height = height;
+    frame->format = format;
+    int ret = av_frame_get_buffer(frame, 0);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Could not allocate the video frame\n");
+    }
+    return ret;
+}
+
+void conv_cache_free(ConvCache *cache) {
+    for (int k = 0; k < CONV_CACHE_SIZE; k++) {
+        sws_freeContext(cache->entries[k].ctx);
+        cache->entries[k].ctx = NULL;
+    }
+    av_log(NULL, AV_LOG_DEBUG, "conversion cache: %"PRId64" hits, %"PRId64" contexts created\n",
+           cache->hits, cache->creates);
+}
+
+void exporter_free(Exporter *ex) {
+    conv_cache_free(&ex->conv);
+    seq_free(&ex->seq);
+}
+
+void exporter_log_rss(const Exporter *ex) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        av_log(NULL, AV_LOG_INFO, "frame %"PRId64": max rss %ld KB\n", ex->frames, usage.ru_maxrss);
+    }
+}
@@ -0,0 +1,188 @@
+#include "dec_tool.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/error.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+
+void dec_options_init(DecOptions *opts) {
+    opts->threads = 0;
+    opts->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+}
+
+int dec_options_parse(DecOptions *opts, const char *name, const char *value) {
+    if (strcmp(name, "decode-threads") == 0) {
+        char *end;
+        long v = strtol(value, &end, 10);
+        if (end == value || *end || v < 0) {
+            av_log(NULL, AV_LOG_ERROR, "invalid value for %s: %s\n", name, value);
+            return AVERROR(EINVAL);
+        }
+        opts->threads = (int) v;
+    } else if (strcmp(name, "decode-thread-type") == 0) {
+        if (strcmp(value, "frame") == 0) {
+            opts->thread_type = FF_THREAD_FRAME;
+        } else if (strcmp(value, "slice") == 0) {
+            opts->thread_type = FF_THREAD_SLICE;
+        } else if (strcmp(value, "auto") == 0) {
+            opts->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+        } else {
+            av_log(NULL, AV_LOG_ERROR, "decode-thread-type must be frame, slice or auto\n");
+            return AVERROR(EINVAL);
+        }
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+void dec_options_apply(const DecOptions *opts, AVCodecContext *ctx) {
+    ctx->thread_count = opts->threads;
+    ctx->thread_type = opts->thread_type;
+}
+
+void dec_options_log(const AVCodecContext *ctx) {
+    av_log(NULL, AV_LOG_INFO, "decoder %s: %dx%d, threads %d (%s)\n",
+           ctx->codec->name, ctx->width, ctx->height, ctx->thread_count,
+           ctx->active_thread_type == FF_THREAD_FRAME ? "frame" :
+           ctx->active_thread_type == FF_THREAD_SLICE ? "slice" : "none");
+}
+
+void dec_log_throughput(const AVCodecContext *ctx, int64_t frames, int64_t start) {
+    double seconds = (av_gettime_relative() - start) / 1000000.0;
+    av_log(NULL, AV_LOG_INFO, "decoded %"PRId64" frames in %.3f s, %.1f fps, %d threads\n",
+           frames, seconds, seconds > 0 ? frames / seconds : 0.0, ctx->thread_count);
+}
+
+struct DecInput {
+    AVFormatContext *fmt_ctx;
+    AVCodecContext *ctx;
+    AVPacket *pkt;
+    int stream;
+    int flushing;
+    int64_t last_pts;
+
+    // 统计
+    int64_t frames;
+    int64_t start;
+};
+
+int dec_input_open(DecInput **pin, const char *path, const DecOptions *opts) {
+    DecInput *in = av_mallocz(sizeof(*in));
+    if (!in) {
+        return AVERROR(ENOMEM);
+    }
+    in->last_pts = AV_NOPTS_VALUE;
+    int ret = avformat_open_input(&in->fmt_ctx, path, NULL, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Could not open %s: %s\n", path, av_err2str(ret));
+        goto fail;
+    }
+    ret = avformat_find_stream_info(in->fmt_ctx, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Could not find stream info of %s: %s\n", path, av_err2str(ret));
+        goto fail;
+    }
+    in->stream = av_find_best_stream(in->fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (in->stream < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s does not include video stream!\n", path);
+        ret = in->stream;
+        goto fail;
+    }
+    AVStream *st = in->fmt_ctx->streams[in->stream];
+
+    const AVCodec *codec = avcodec_find_decoder(st->codecpar->codec_id);
+    if (!codec) {
+        av_log(NULL, AV_LOG_ERROR, "Could not find Codec\n");
+        ret = AVERROR_DECODER_NOT_FOUND;
+        goto fail;
+    }
+    in->ctx = avcodec_alloc_context3(codec);
+    in->pkt = av_packet_alloc();
+    if (!in->ctx || !in->pkt) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    ret = avcodec_parameters_to_context(in->ctx, st->codecpar);
+    if (ret < 0) {
+        goto fail;
+    }
+    in->ctx->pkt_timebase = st->time_base;
+    dec_options_apply(opts, in->ctx);
+    ret = avcodec_open2(in->ctx, codec, NULL);
+    if (ret < 0) {
+        av_log(in->ctx, AV_LOG_ERROR, "Don't open codec: %s \n", av_err2str(ret));
+        goto fail;
+    }
+    dec_options_log(in->ctx);
+    in->start = av_gettime_relative();
+    *pin = in;
+    return 0;
+fail:
+    dec_input_close(&in);
+    return ret;
+}
+
+const AVStream *dec_input_stream(const DecInput *in) {
+    return in->fmt_ctx->streams[in->stream];
+}
+
+int dec_input_read(DecInput *in, AVFrame *frame) {
+    for (;;) {
+        int ret = avcodec_receive_frame(in->ctx, frame);
+        if (ret >= 0) {
+            // 编码器要求 pts 严格递增，源时间戳缺失或乱序的帧接在上一帧之后
+            int64_t pts = frame->best_effort_timestamp;
+            if (in->last_pts != AV_NOPTS_VALUE && (pts == AV_NOPTS_VALUE || pts <= in->last_pts)) {
+                pts = in->last_pts + 1;
+            } else if (pts == AV_NOPTS_VALUE) {
+                pts = 0;
+            }
+            frame->pts = in->last_pts = pts;
+            in->frames++;
+            return 0;
+        }
+        if (ret != AVERROR(EAGAIN) || in->flushing) {
+            return ret == AVERROR(EAGAIN) ? AVERROR_EOF : ret;
+        }
+
+        ret = av_read_frame(in->fmt_ctx, in->pkt);
+        if (ret == AVERROR_EOF) {
+            // 送入空包，取出解码器中剩余的帧
+            in->flushing = 1;
+            ret = avcodec_send_packet(in->ctx, NULL);
+            if (ret < 0) {
+                return ret;
+            }
+            continue;
+        } else if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Could not read packet: %s\n", av_err2str(ret));
+            return ret;
+        }
+        if (in->pkt->stream_index == in->stream) {
+            ret = avcodec_send_packet(in->ctx, in->pkt);
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_WARNING, "failed to send packet to decoder: %s\n", av_err2str(ret));
+            }
+        }
+        av_packet_unref(in->pkt);
+    }
+}
+
+void dec_input_close(DecInput **pin) {
+    DecInput *in = *pin;
+    if (!in) {
+        return;
+    }
+    if (in->start) {
+        dec_log_throughput(in->ctx, in->frames, in->start);
+    }
+    avformat_close_input(&in->fmt_ctx);
+    avcodec_free_context(&in->ctx);
+    av_packet_free(&in->pkt);
+    av_freep(pin);
+}
@@ -0,0 +1,240 @@
+#include "enc_tool.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+
+void enc_options_init(EncOptions *opts) {
+    memset(opts, 0, sizeof(*opts));
+    // 与 libavcodec 的默认值一致，单线程编码
+    opts->threads = 1;
+    opts->thread_type = 0;
+    opts->bit_rate = -1;
+    opts->gop_size = 10;
+    opts->max_b_frames = 1;
+    opts->framerate = (AVRational){25, 1};
+}
+
+void enc_options_free(EncOptions *opts) {
+    av_freep(&opts->preset);
+    av_freep(&opts->tune);
+    av_freep(&opts->crf);
+    av_dict_free(&opts->dict);
+}
+
+static int parse_int(const char *name, const char *value, int *out) {
+    char *end;
+    long v = strtol(value, &end, 10);
+    if (end == value || *end) {
+        av_log(NULL, AV_LOG_ERROR, "invalid value for %s: %s\n", name, value);
+        return AVERROR(EINVAL);
+    }
+    *out = (int) v;
+    return 1;
+}
+
+static int parse_bit_rate(const char *value, int64_t *out) {
+    char *end;
+    double v = strtod(value, &end);
+    if (end == value) {
+        goto fail;
+    }
+    if (*end == 'k' || *end == 'K') {
+        v *= 1000;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        v *= 1000000;
+        end++;
+    }
+    if (*end || v < 0) {
+        goto fail;
+    }
+    *out = (int64_t) v;
+    return 1;
+fail:
+    av_log(NULL, AV_LOG_ERROR, "invalid bitrate: %s\n", value);
+    return AVERROR(EINVAL);
+}
+
+static int set_string(char **dst, const char *value) {
+    av_freep(dst);
+    *dst = av_strdup(value);
+    return *dst ? 1 : AVERROR(ENOMEM);
+}
+
+int enc_options_parse(EncOptions *opts, const char *name, const char *value) {
+    if (strcmp(name, "threads") == 0) {
+        return parse_int(name, value, &opts->threads);
+    } else if (strcmp(name, "thread-type") == 0) {
+        if (strcmp(value, "frame") == 0) {
+            opts->thread_type = FF_THREAD_FRAME;
+        } else if (strcmp(value, "slice") == 0) {
+            opts->thread_type = FF_THREAD_SLICE;
+        } else if (strcmp(value, "auto") == 0) {
+            opts->thread_type = 0;
+        } else {
+            av_log(NULL, AV_LOG_ERROR, "thread-type must be frame, slice or auto\n");
+            return AVERROR(EINVAL);
+        }
+        return 1;
+    } else if (strcmp(name, "preset") == 0) {
+        return set_string(&opts->preset, value);
+    } else if (strcmp(name, "tune") == 0) {
+        return set_string(&opts->tune, value);
+    } else if (strcmp(name, "crf") == 0) {
+        return set_string(&opts->crf, value);
+    } else if (strcmp(name, "bitrate") == 0) {
+        return parse_bit_rate(value, &opts->bit_rate);
+    } else if (strcmp(name, "gop") == 0) {
+        return parse_int(name, value, &opts->gop_size);
+    } else if (strcmp(name, "bframes") == 0) {
+        return parse_int(name, value, &opts->max_b_frames);
+    } else if (strcmp(name, "fps") == 0) {
+        int fps;
+        int ret = parse_int(name, value, &fps);
+        if (ret < 0 || fps <= 0) {
+            return AVERROR(EINVAL);
+        }
+        opts->framerate = (AVRational){fps, 1};
+        return 1;
+    } else if (strcmp(name, "enc-opt") == 0) {
+        const char *eq = strchr(value, '=');
+        if (!eq || eq == value) {
+            av_log(NULL, AV_LOG_ERROR, "enc-opt must be key=value: %s\n", value);
+            return AVERROR(EINVAL);
+        }
+        char key[128];
+        snprintf(key, sizeof(key), "%.*s", (int) (eq - value), value);
+        int ret = av_dict_set(&opts->dict, key, eq + 1, 0);
+        return ret < 0 ? ret : 1;
+    } else if (strcmp(name, "enc-options") == 0) {
+        int ret = enc_options_load(opts, value);
+        return ret < 0 ? ret : 1;
+    }
+    return 0;
+}
+
+static char *trim(char *s) {
+    while (isspace((unsigned char) *s)) {
+        s++;
+    }
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char) end[-1])) {
+        *--end = 0;
+    }
+    return s;
+}
+
+int enc_options_load(EncOptions *opts, const char *filename) {
+    char line[1024];
+    int ret = 0, lineno = 0;
+    FILE *f = fopen(filename, "r");
+    if (!f) {
+        av_log(NULL, AV_LOG_ERROR, "Don't open file: %s\n", filename);
+        return AVERROR(errno);
+    }
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *name = trim(line);
+        if (!*name || *name == '#') {
+            continue;
+        }
+        char *eq = strchr(name, '=');
+        if (!eq) {
+            av_log(NULL, AV_LOG_ERROR, "%s:%d: expected name=value\n", filename, lineno);
+            ret = AVERROR(EINVAL);
+            break;
+        }
+        *eq = 0;
+        name = trim(name);
+        char *value = trim(eq + 1);
+        // 参数文件不能再引用参数文件，否则自引用的文件会无限递归
+        if (strcmp(name, "enc-options") == 0) {
+            av_log(NULL, AV_LOG_ERROR, "%s:%d: nested enc-options is not allowed\n", filename, lineno);
+            ret = AVERROR(EINVAL);
+            break;
+        }
+        ret = enc_options_parse(opts, name, value);
+        if (ret == 0) {
+            av_log(NULL, AV_LOG_ERROR, "%s:%d: unknown option %s\n", filename, lineno, name);
+            ret = AVERROR(EINVAL);
+        }
+        if (ret < 0) {
+            break;
+        }
+    }
+    fclose(f);
+    return ret < 0 ? ret : 0;
+}
+
+static int set_private(AVCodecContext *ctx, const char *name, const char *value) {
+    int ret = ctx->priv_data ? av_opt_set(ctx->priv_data, name, value, 0) : AVERROR_OPTION_NOT_FOUND;
+    if (ret < 0) {
+        av_log(ctx, AV_LOG_WARNING, "encoder %s does not support %s=%s\n", ctx->codec->name, name, value);
+    }
+    return ret;
+}
+
+int enc_options_apply(const EncOptions *opts, AVCodecContext *ctx, AVDictionary **dict) {
+    ctx->time_base = av_inv_q(opts->framerate);
+    ctx->framerate = opts->framerate;
+    ctx->gop_size = opts->gop_size;
+    ctx->max_b_frames = opts->max_b_frames;
+    ctx->thread_count = opts->threads;
+    if (opts->thread_type) {
+        ctx->thread_type = opts->thread_type;
+    }
+    // 指定 crf 时交给编码器做质量控制，除非同时指定了码率
+    if (opts->bit_rate >= 0) {
+        ctx->bit_rate = opts->bit_rate;
+    } else if (!opts->crf) {
+        ctx->bit_rate = 500000;
+    }
+
+    if (opts->preset) {
+        set_private(ctx, "preset", opts->preset);
+    } else if (ctx->codec->id == AV_CODEC_ID_H264) {
+        av_opt_set(ctx->priv_data, "preset", "slow", 0);
+    }
+    if (opts->tune) {
+        set_private(ctx, "tune", opts->tune);
+    }
+    if (opts->crf) {
+        set_private(ctx, "crf", opts->crf);
+    }
+    return av_dict_copy(dict, opts->dict, 0);
+}
+
+void enc_options_log(const AVCodecContext *ctx, const AVDictionary *unused) {
+    uint8_t *preset = NULL, *tune = NULL, *crf = NULL;
+    if (ctx->priv_data) {
+        av_opt_get(ctx->priv_data, "preset", 0, &preset);
+        av_opt_get(ctx->priv_data, "tune", 0, &tune);
+        av_opt_get(ctx->priv_data, "crf", 0, &crf);
+    }
+
+    av_log(NULL, AV_LOG_INFO,
+           "encoder %s: %dx%d %s, %d/%d fps, bitrate %"PRId64", crf %s, gop %d, bframes %d, "
+           "threads %d (%s), preset %s, tune %s\n",
+           ctx->codec->name, ctx->width, ctx->height, av_get_pix_fmt_name(ctx->pix_fmt),
+           ctx->framerate.num, ctx->framerate.den, ctx->bit_rate, crf ? (char *) crf : "-",
+           ctx->gop_size, ctx->max_b_frames, ctx->thread_count,
+           ctx->active_thread_type == FF_THREAD_FRAME ? "frame" :
+           ctx->active_thread_type == FF_THREAD_SLICE ? "slice" : "none",
+           preset ? (char *) preset : "-", tune ? (char *) tune : "-");
+
+    const AVDictionaryEntry *e = NULL;
+    while ((e = av_dict_iterate(unused, e))) {
+        av_log(NULL, AV_LOG_WARNING, "encoder option %s=%s was not used\n", e->key, e->value);
+    }
+    av_free(preset);
+    av_free(tune);
+    av_free(crf);
+}
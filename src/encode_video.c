@@ -1,8 +1,12 @@
 #include <libavutil/log.h>
 #include <libavutil/opt.h>
 #include <libavcodec/avcodec.h>
+#include <string.h>
 
-static int encode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, FILE *out) {
+#include "enc_tool.h"
+#include "mux_tool.h"
+
+static int encode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, Muxer *mux) {
     int ret = avcodec_send_frame(ctx, frame);
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR, "Failed to send frame to encoder!\n");
@@ -17,78 +21,121 @@ static int encode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, FILE *out)
             return -1;
         }
 
-        fwrite(pkt->data, 1, pkt->size, out);
-        av_packet_unref(pkt);
+        // 包的引用交给封装器
+        if (mux_write(mux, pkt) < 0) {
+            return -1;
+        }
     }
 end:
     return 0;
 }
 
-// output.mp4 mpeg4
+// output.mp4 mpeg4 [encoder options] [--faststart 1]
 int main(int argc, char* argv[]){
 
+    EncOptions enc_opts;
+    AVDictionary *enc_dict = NULL;
+    MuxOptions mux_opts;
+    Muxer *mux = NULL;
+    AVCodecContext *ctx = NULL;
+    AVFrame *frame = NULL;
+    AVPacket *pkt = NULL;
+    int ret = 0;
+
     av_log_set_level(AV_LOG_DEBUG);
+    enc_options_init(&enc_opts);
+    mux_options_init(&mux_opts);
 
     // 输入参数
     if (argc < 3) {
         av_log(NULL, AV_LOG_ERROR, "arguments must be more than 3\n");
+        ret = AVERROR(EINVAL);
         goto err;
     }
     char *dst = argv[1];
     char *codecname = argv[2];
-    
+
+    // 编码器与封装参数 --name value
+    for (int k = 3; k < argc; k += 2) {
+        if (k + 1 >= argc) {
+            av_log(NULL, AV_LOG_ERROR, "missing value for %s\n", argv[k]);
+            ret = AVERROR(EINVAL);
+            goto err;
+        }
+        ret = strncmp(argv[k], "--", 2) == 0 ? enc_options_parse(&enc_opts, argv[k] + 2, argv[k + 1]) : 0;
+        if (ret == 0 && strncmp(argv[k], "--", 2) == 0) {
+            ret = mux_options_parse(&mux_opts, argv[k] + 2, argv[k + 1]);
+        }
+        if (ret == 0) {
+            av_log(NULL, AV_LOG_ERROR, "unknown option: %s\n", argv[k]);
+            ret = AVERROR(EINVAL);
+            goto err;
+        } else if (ret < 0) {
+            goto err;
+        }
+    }
+
     // 查找编码器
     const AVCodec *codec = avcodec_find_encoder_by_name(codecname);
     if (!codec) {
         av_log(NULL, AV_LOG_ERROR, "don't find Codec: %s\n", codecname);
+        ret = AVERROR_ENCODER_NOT_FOUND;
         goto err;
     }
 
     // 创建编码器上下文
-    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    ctx = avcodec_alloc_context3(codec);
     if (!ctx) {
         av_log(NULL, AV_LOG_ERROR, "NO MEMRORY\n");
+        ret = AVERROR(ENOMEM);
         goto err;
     }
 
     // 设置编码器参数
     ctx->width = 640;
     ctx->height = 480;
-    ctx->bit_rate = 500000;
-    ctx->time_base = (AVRational){1, 25};
-    ctx->framerate = (AVRational){25, 1};
-    ctx->gop_size = 10;
-    ctx->max_b_frames = 1;
     ctx->pix_fmt = AV_PIX_FMT_YUV420P;
-    if (codec->id == AV_CODEC_ID_H264) {
-        av_opt_set(ctx->priv_data, "preset", "slow", 0);
+    ret = enc_options_apply(&enc_opts, ctx, &enc_dict);
+    if (ret < 0) {
+        goto err;
+    }
+
+    // 创建输出文件，容器格式由扩展名决定
+    ret = mux_alloc(&mux, dst, &mux_opts);
+    if (ret < 0) {
+        goto err;
+    }
+    if (mux_need_global_header(mux)) {
+        ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
     }
 
     // 编码器与编码器上下文绑定到一起
-    int ret = avcodec_open2(ctx, codec, NULL);
+    ret = avcodec_open2(ctx, codec, &enc_dict);
     if (ret < 0) {
         av_log(ctx, AV_LOG_ERROR, "Don't open codec: %s \n", av_err2str(ret));
         goto err;
     }
+    enc_options_log(ctx, enc_dict);
 
-    // 创建输出文件
-    FILE *f = fopen(dst, "wb");
-    if (!f) {
-        av_log(NULL, AV_LOG_ERROR, "Don't open file: %s\n", dst);
+    // 写入文件头，之后的数据由写线程落盘
+    ret = mux_start(mux, ctx);
+    if (ret < 0) {
         goto err;
     }
 
     // 创建AVFrame
-    AVFrame *frame = av_frame_alloc();
+    frame = av_frame_alloc();
     if (!frame) {
         av_log(NULL, AV_LOG_ERROR, "NO MEMORY\n");
+        ret = AVERROR(ENOMEM);
         goto err;
     }
 
     // 创建AVPacket
-    AVPacket *pkt = av_packet_alloc();
+    pkt = av_packet_alloc();
     if (!pkt) {
         av_log(NULL, AV_LOG_ERROR, "NO MEMORY\n");
+        ret = AVERROR(ENOMEM);
         goto err;
     }
 
@@ -106,7 +153,7 @@ int main(int argc, char* argv[]){
     for (int i = 0; i < 25; i++) {
         ret = av_frame_make_writable(frame);
         if (ret < 0) {
-            break;
+            goto err;
         }
 
         // Y分量
@@ -126,26 +173,30 @@ int main(int argc, char* argv[]){
         frame->pts = i;
 
         // 编码
-        ret = encode(ctx, frame, pkt, f);
+        ret = encode(ctx, frame, pkt, mux);
         if (ret == -1) {
             goto err;
         }
     }
 
-    encode(ctx, NULL, pkt, f);
+    ret = encode(ctx, NULL, pkt, mux);
 
 err:
     if (ctx) {
         avcodec_free_context(&ctx);
     }
+    av_dict_free(&enc_dict);
+    enc_options_free(&enc_opts);
     if (frame) {
         av_frame_free(&frame);
     }
     if (pkt) {
         av_packet_free(&pkt);
     }
-    if (f) {
-        fclose(f);
+    // 写线程落盘失败时同样以错误退出
+    int mux_ret = mux_close(&mux);
+    if (mux_ret < 0 && ret >= 0) {
+        ret = mux_ret;
     }
-    return 0;
+    return ret < 0 ? -1 : 0;
 }
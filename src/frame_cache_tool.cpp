@@ -0,0 +1,76 @@
+#include "frame_cache_tool.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+FrameCache::FrameCache(size_t max_entries, size_t max_bytes)
+        : max_entries_(max_entries), max_bytes_(max_bytes) {
+}
+
+void FrameCache::evict() {
+    while (!lru_.empty() && (entries_.size() > max_entries_ || bytes_ > max_bytes_)) {
+        auto it = entries_.find(lru_.back());
+        bytes_ -= it->second.bytes;
+        entries_.erase(it);
+        lru_.pop_back();
+        evictions_++;
+    }
+}
+
+bool FrameCache::get(uint64_t key, AVFrame *frame) {
+    std::shared_ptr<const AVFrame> cached;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it == entries_.end()) {
+            misses_++;
+            return false;
+        }
+        hits_++;
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+        cached = it->second.frame;
+    }
+
+    // 拷贝在锁外进行，条目被淘汰时由 shared_ptr 保证像素仍然有效
+    return av_frame_copy(frame, cached.get()) >= 0;
+}
+
+void FrameCache::put(uint64_t key, const AVFrame *frame) {
+    int size = av_image_get_buffer_size((AVPixelFormat) frame->format, frame->width, frame->height, 1);
+    if (size <= 0 || (size_t) size > max_bytes_ || !max_entries_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (entries_.count(key)) {
+            return;
+        }
+    }
+
+    AVFrame *copy = av_frame_alloc();
+    if (!copy) {
+        return;
+    }
+    copy->format = frame->format;
+    copy->width = frame->width;
+    copy->height = frame->height;
+    if (av_frame_get_buffer(copy, 0) < 0 || av_frame_copy(copy, frame) < 0) {
+        av_frame_free(&copy);
+        return;
+    }
+    std::shared_ptr<const AVFrame> cached(copy, [](const AVFrame *f) {
+        AVFrame *p = const_cast<AVFrame *>(f);
+        av_frame_free(&p);
+    });
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.count(key)) {
+        // 另一个线程已插入同一内容
+        return;
+    }
+    lru_.push_front(key);
+    entries_[key] = Entry{cached, (size_t) size, lru_.begin()};
+    bytes_ += size;
+    evict();
+}
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/time.h>
+
+#include "dec_tool.h"
+#include "out_tool.h"
+#include "pack_tool.h"
+#include "png_tool.h"
+#include "select_tool.h"
+#include "seq_tool.h"
+#include "sink_tool.h"
+
+#define MAX_SINKS 8
+
+// 一次解码，把选中的每一帧分发给所有输出端
+static int decode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, FrameSelect *sel,
+                  FrameSink **sinks, int nb_sinks) {
+    int ret = avcodec_send_packet(ctx, pkt);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "failed to send frame to decode\n");
+        return 0;
+    }
+
+    while (ret >= 0) {
+        ret = avcodec_receive_frame(ctx, frame);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            return 0;
+        } else if (ret < 0) {
+            return -1;
+        }
+
+        ret = select_frame(sel, frame);
+        if (ret <= 0) {
+            av_frame_unref(frame);
+            if (ret < 0) {
+                return ret;
+            }
+            ret = 0;
+            continue;
+        }
+
+        // 各输出端只持有引用，解码器下一帧会分配新的缓冲区；输出按选中的顺序连续编号
+        for (int k = 0; k < nb_sinks; k++) {
+            if (sink_push(sinks[k], frame, sel->selected - 1) < 0) {
+                av_frame_unref(frame);
+                return -1;
+            }
+        }
+        av_frame_unref(frame);
+    }
+    return 0;
+}
+
+// input.mp4 --png png/%06d.png --pgm luma/%06d.pgm [--ppm ...] [--bmp ...] [--y4m all.y4m] [--raw all.raw]
+//           [--sink-queue 8] [--start-number 1] [--shard 1000] [--png-threads 8] [--png-preset fast]
+//           [--start 00:10:00] [--end 00:20:00] [--every 25] [--fps 1] [--keyframes 1] [--seek-gap 10]
+//           [--decode-threads 0] [--decode-thread-type auto]
+//           [--out-backend auto|uring|threads] [--out-depth 64] [--out-batch 16] [--out-threads 4] [--out-fsync none]
+//           [--pack-buffer-mb 8]
+int main(int argc, char **argv) {
+    const char *src;
+    int ret = 0;
+    AVFormatContext *fmt_ctx = NULL;
+    AVCodecContext *ctx = NULL;
+    AVFrame *frame = NULL;
+    AVPacket *pkt = NULL;
+    FrameSink *sinks[MAX_SINKS] = {NULL};
+    const char *sink_types[MAX_SINKS];
+    const char *sink_patterns[MAX_SINKS];
+    int nb_sinks = 0;
+    int sink_queue = 8;
+    FrameSelect sel;
+
+    av_log_set_level(AV_LOG_DEBUG);
+
+    if (argc <= 3) {
+        fprintf(stderr, "Usage: %s <input file> --<pgm|ppm|bmp|png|y4m|raw> <output pattern|file> ...\n", argv[0]);
+        exit(0);
+    }
+    src = argv[1];
+
+    // 输出端、帧序列、PNG、选帧、解码器、小文件与单文件输出参数 --name value，帧序列参数对所有输出端生效
+    SeqOptions seq_opts;
+    PngOptions png_opts;
+    SelectOptions select_opts;
+    DecOptions dec_opts;
+    OutOptions out_opts;
+    PackOptions pack_opts;
+    seq_options_init(&seq_opts);
+    png_options_init(&png_opts);
+    select_options_init(&select_opts);
+    dec_options_init(&dec_opts);
+    out_options_init(&out_opts);
+    pack_options_init(&pack_opts);
+    for (int k = 2; k < argc; k += 2) {
+        if (k + 1 >= argc || strncmp(argv[k], "--", 2) != 0) {
+            av_log(NULL, AV_LOG_ERROR, "invalid option: %s\n", argv[k]);
+            exit(-1);
+        }
+        const char *name = argv[k] + 2;
+        if (sink_type_supported(name)) {
+            if (nb_sinks == MAX_SINKS) {
+                av_log(NULL, AV_LOG_ERROR, "too many outputs, at most %d\n", MAX_SINKS);
+                exit(-1);
+            }
+            sink_types[nb_sinks] = name;
+            sink_patterns[nb_sinks] = argv[k + 1];
+            nb_sinks++;
+            continue;
+        }
+        if (strcmp(name, "sink-queue") == 0) {
+            sink_queue = atoi(argv[k + 1]);
+            continue;
+        }
+        ret = seq_options_parse(&seq_opts, name, argv[k + 1]);
+        if (ret == 0) {
+            ret = png_options_parse(&png_opts, name, argv[k + 1]);
+        }
+        if (ret == 0) {
+            ret = select_options_parse(&select_opts, name, argv[k + 1]);
+        }
+        if (ret == 0) {
+            ret = dec_options_parse(&dec_opts, name, argv[k + 1]);
+        }
+        if (ret == 0) {
+            ret = out_options_parse(&out_opts, name, argv[k + 1]);
+        }
+        if (ret == 0) {
+            ret = pack_options_parse(&pack_opts, name, argv[k + 1]);
+        }
+        if (ret <= 0) {
+            av_log(NULL, AV_LOG_ERROR, "invalid option: %s\n", argv[k]);
+            exit(-1);
+        }
+    }
+    if (!nb_sinks) {
+        av_log(NULL, AV_LOG_ERROR, "no output given\n");
+        exit(-1);
+    }
+
+    // 打开多媒体文件
+    ret = avformat_open_input(&fmt_ctx, src, NULL, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s\n", av_err2str(ret));
+        goto err;
+    }
+
+    // 从多媒体文件中找到视频流
+    int idx = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (idx < 0) {
+        av_log(fmt_ctx, AV_LOG_ERROR, "Does not include video stream!\n");
+        ret = idx;
+        goto err;
+    }
+    AVStream *in_stream = fmt_ctx->streams[idx];
+
+    // 查找解码器
+    const AVCodec *codec = avcodec_find_decoder(in_stream->codecpar->codec_id);
+    if (!codec) {
+        av_log(NULL, AV_LOG_ERROR, "Could not find Codec\n");
+        ret = AVERROR_DECODER_NOT_FOUND;
+        goto err;
+    }
+
+    // 创建解码器上下文
+    ctx = avcodec_alloc_context3(codec);
+    if (!ctx) {
+        av_log(NULL, AV_LOG_ERROR, "NO MEMORY\n");
+        ret = AVERROR(ENOMEM);
+        goto err;
+    }
+    avcodec_parameters_to_context(ctx, in_stream->codecpar);
+
+    // 线程参数必须在打开解码器之前设置
+    dec_options_apply(&dec_opts, ctx);
+
+    // 解码器与解码器上下文绑定到一起
+    ret = avcodec_open2(ctx, codec, NULL);
+    if (ret < 0) {
+        av_log(ctx, AV_LOG_ERROR, "Don't open codec: %s \n", av_err2str(ret));
+        goto err;
+    }
+    dec_options_log(ctx);
+
+    // 关键帧模式与 --start 的 seek 需要在解码器打开之后设置
+    select_start(&sel, &select_opts, fmt_ctx, idx, ctx);
+
+    frame = av_frame_alloc();
+    pkt = av_packet_alloc();
+    if (!frame || !pkt) {
+        av_log(NULL, AV_LOG_ERROR, "NO MEMORY!\n");
+        ret = AVERROR(ENOMEM);
+        goto err;
+    }
+
+    // 单文件记录输出帧的帧率：--fps 直接作为帧率，--every N 为原帧率的 1/N
+    AVRational rate = in_stream->avg_frame_rate.num ? in_stream->avg_frame_rate : in_stream->r_frame_rate;
+    if (select_opts.fps > 0) {
+        rate = av_d2q(select_opts.fps, 1001000);
+    } else if (rate.num > 0 && rate.den > 0) {
+        rate = av_mul_q(rate, (AVRational) {1, select_opts.every});
+    }
+    if (rate.num > 0 && rate.den > 0) {
+        pack_opts.frame_rate = rate;
+    }
+    pack_opts.time_base = in_stream->time_base;
+
+    // 每个输出端一个线程
+    for (int k = 0; k < nb_sinks; k++) {
+        ret = sink_open(&sinks[k], sink_types[k], sink_patterns[k], &seq_opts, &png_opts, &out_opts, &pack_opts,
+                        sink_queue);
+        if (ret < 0) {
+            goto err;
+        }
+    }
+
+    int64_t start = av_gettime_relative();
+    while ((ret = av_read_frame(fmt_ctx, pkt)) >= 0) {
+        if (pkt->stream_index == idx) {
+            ret = select_packet(&sel, pkt);
+            if (ret > 0) {
+                ret = decode(ctx, frame, pkt, &sel, sinks, nb_sinks);
+            }
+        }
+        av_packet_unref(pkt);
+        if (ret < 0) {
+            break;
+        }
+    }
+    // 读到结尾或超出 --end 后取出解码器里剩余的帧
+    if (ret == AVERROR_EOF) {
+        ret = decode(ctx, frame, NULL, &sel, sinks, nb_sinks);
+        ret = ret == AVERROR_EOF ? 0 : ret;
+    }
+    select_log(&sel);
+    dec_log_throughput(ctx, sel.selected, start);
+
+err:
+    // 等各输出端写完队列中的帧
+    for (int k = 0; k < nb_sinks; k++) {
+        int sink_ret = sink_close(&sinks[k]);
+        if (sink_ret < 0 && ret >= 0) {
+            ret = sink_ret;
+        }
+    }
+    avformat_close_input(&fmt_ctx);
+    avcodec_free_context(&ctx);
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    return ret < 0 ? -1 : 0;
+}
@@ -3,18 +3,42 @@ extern "C" {
 #include <libavutil/opt.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/parseutils.h>
+#include <libavutil/pixdesc.h>
 #include <libswscale/swscale.h>
+#include <sys/stat.h>
 #include <unistd.h>
 }
 
+#include <Magick++/Blob.h>
 #include <Magick++/Image.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include "frame_cache_tool.h"
 #include "gm_tool.h"
-#include "json_tool.h"
-#include "file_tool.h"
+#include "hash_tool.h"
+#include "scene_tool.h"
+#include "overlay_tool.h"
+#include "blend_tool.h"
+#include "queue_tool.h"
+#include "dec_tool.h"
+#include "enc_tool.h"
+#include "mux_tool.h"
+#include "pack_tool.h"
+#include "seq_tool.h"
+#include "prefetch_tool.h"
 
-static int encode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, FILE *out) {
+static int encode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, Muxer *mux) {
     int ret = avcodec_send_frame(ctx, frame);
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR, "Failed to send frame to encoder!\n");
@@ -27,27 +51,527 @@ static int encode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, FILE *out)
         } else if (ret < 0) {
             return -1;
         }
-        fwrite(pkt->data, 1, pkt->size, out);
-        av_packet_unref(pkt);
+        // 包的引用交给封装器
+        if (mux_write(mux, pkt) < 0) {
+            return -1;
+        }
     }
 end:
     return 0;
 }
 
-// output.mp4 mpeg4 %03d.png||%03d.bmp 352 288 overlay.png test.json
+// 流水线中循环复用的帧
+struct FrameSlot {
+    AVFrame *frame = nullptr;
+    // 输入流在这个序号处结束，槽位中没有帧
+    bool end = false;
+    // 叠加改动的区域
+    std::vector<SceneRect> dirty;
+    // 叠加前背景像素的哈希，只在 RGB 域混合时计算，0 为未计算
+    uint64_t background = 0;
+
+    ~FrameSlot() {
+        av_frame_free(&frame);
+    }
+};
+
+// 读取 → 叠加 → 转换 → 编码 流水线，各阶段之间以按序号排列的无锁环形队列连接
+struct Pipeline {
+    const FrameSeq *seq;
+    // 预读线程，为空时直接按路径读取
+    Prefetcher *prefetch = nullptr;
+    // 背景为 y4m/raw 单文件时按帧号读取，不经过 GraphicsMagick
+    PackReader *pack = nullptr;
+    // 背景来自标准输入、管道或视频文件时只能顺序读取，领取序号与读取在同一把锁内
+    PackStream *stream = nullptr;
+    DecInput *video = nullptr;
+    std::mutex stream_lock;
+    bool stream_end = false;
+    Scene *scene;
+    // 背景图片按文件内容去重，为空时每帧都解码
+    FrameCache *bg_cache = nullptr;
+    bool yuv_blend;
+    // 顺序读取时帧数未知，取 INT_MAX，以带 end 标记的槽位结束
+    int total;
+
+    // 读取叠加阶段的输出：RGB24，YUV 域混合时直接为编码器像素格式
+    std::unique_ptr<OrderedRing<FrameSlot>> render_ring;
+    // 转换阶段的输出，YUV 域混合时不使用
+    std::unique_ptr<OrderedRing<FrameSlot>> convert_ring;
+    std::atomic<int> next{0};
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> threads;
+
+    // 转换阶段统计：背景与上一帧相同时只转换新旧改动区域所在的行
+    int convert_frames = 0;
+    int convert_reused = 0;
+    int64_t convert_rows = 0;
+    int64_t convert_reused_rows = 0;
+    int64_t total_rows = 0;
+    int64_t reused_total_rows = 0;
+};
+
+static void pipeline_fail(Pipeline *p) {
+    p->failed = true;
+    prefetch_abort(p->prefetch);
+    p->render_ring->abort();
+    if (p->convert_ring) {
+        p->convert_ring->abort();
+    }
+}
+
+static void pipeline_join(Pipeline *p) {
+    for (auto &t: p->threads) {
+        t.join();
+    }
+    p->threads.clear();
+}
+
+static int alloc_ring_frames(OrderedRing<FrameSlot> *ring, enum AVPixelFormat format, int width, int height) {
+    int ret = 0;
+    ring->for_each([&](FrameSlot &slot) {
+        slot.frame = av_frame_alloc();
+        if (!slot.frame) {
+            ret = AVERROR(ENOMEM);
+            return;
+        }
+        slot.frame->format = format;
+        slot.frame->width = width;
+        slot.frame->height = height;
+        if (ret >= 0) {
+            ret = av_frame_get_buffer(slot.frame, 0);
+        }
+    });
+    return ret;
+}
+
+// 读入整个文件，用于计算内容哈希
+static int read_file(const char *path, std::vector<uint8_t> *data) {
+    std::unique_ptr<FILE, int (*)(FILE *)> file(fopen(path, "rb"), fclose);
+    struct stat st;
+    if (!file || fstat(fileno(file.get()), &st) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Could not open background: %s\n", path);
+        return AVERROR(errno);
+    }
+    data->resize(st.st_size);
+    if (fread(data->data(), 1, data->size(), file.get()) != data->size()) {
+        av_log(NULL, AV_LOG_ERROR, "Could not read background: %s\n", path);
+        return AVERROR(EIO);
+    }
+    return 0;
+}
+
+// 读取第 i 帧背景图片，转换到 frame 的像素格式。启用去重时按文件内容的哈希查找已转换好的帧，命中则不再解码
+static int load_background(Pipeline *p, int i, AVFrame *frame, struct SwsContext **bg_sws_ctx) {
+    char path[4096];
+    int ret = seq_path(p->seq, i, path, sizeof(path));
+    if (ret < 0) {
+        return ret;
+    }
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    std::unique_ptr<PrefetchBuf, void (*)(PrefetchBuf *)> guard(nullptr, prefetch_release);
+    std::vector<uint8_t> file;
+    if (p->prefetch) {
+        PrefetchBuf *buf;
+        ret = prefetch_get(p->prefetch, i, &buf);
+        if (ret < 0) {
+            return ret;
+        }
+        guard.reset(buf);
+        data = buf->data;
+        size = buf->size;
+    } else if (p->bg_cache) {
+        ret = read_file(path, &file);
+        if (ret < 0) {
+            return ret;
+        }
+        data = file.data();
+        size = file.size();
+    }
+
+    uint64_t key = 0;
+    if (p->bg_cache) {
+        key = hash_bytes(data, size, size);
+        if (p->bg_cache->get(key, frame)) {
+            return 0;
+        }
+    }
+
+    Magick::Image background;
+    if (data) {
+        background.read(Magick::Blob(data, size));
+        // 解码后立即归还，预读线程才能继续往前读
+        guard.reset();
+    } else {
+        background.read(path); // 替换为您的背景图像文件名
+    }
+
+    if (p->yuv_blend) {
+        ret = image_to_yuv_frame(&background, bg_sws_ctx, frame);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Could not convert background: %s\n", path);
+            return ret;
+        }
+    } else {
+        image_to_frame(&background, frame);
+    }
+    if (p->bg_cache) {
+        p->bg_cache->put(key, frame);
+    }
+    return 0;
+}
+
+// 把按原始平面读入的背景直接转换到 frame 的像素格式与尺寸
+static int convert_packed_background(AVFrame *packed, AVFrame *frame, struct SwsContext **bg_sws_ctx) {
+    *bg_sws_ctx = sws_getCachedContext(*bg_sws_ctx, packed->width, packed->height, (AVPixelFormat) packed->format,
+                                       frame->width, frame->height, (AVPixelFormat) frame->format,
+                                       SWS_BICUBIC, NULL, NULL, NULL);
+    if (!*bg_sws_ctx) {
+        av_log(NULL, AV_LOG_ERROR, "Could not initialize the conversion context\n");
+        av_frame_unref(packed);
+        return AVERROR(EINVAL);
+    }
+    sws_scale(*bg_sws_ctx, (const uint8_t * const *)packed->data, packed->linesize, 0, packed->height,
+              frame->data, frame->linesize);
+    av_frame_unref(packed);
+    return 0;
+}
+
+// 从单文件读取第 i 帧背景
+static int load_packed_background(Pipeline *p, int i, AVFrame *packed, AVFrame *frame,
+                                  struct SwsContext **bg_sws_ctx) {
+    int ret = pack_reader_read(p->pack, i, packed);
+    if (ret < 0) {
+        return ret;
+    }
+    return convert_packed_background(packed, frame, bg_sws_ctx);
+}
+
+static bool sequential_input(const Pipeline *p) {
+    return p->stream || p->video;
+}
+
+// 读取第 i 帧背景并叠加各层，结果写入 slot，记下改动区域与背景哈希；顺序读取时背景已由调用者读入 packed
+static int render_frame(Pipeline *p, int i, FrameSlot *slot, AVFrame *packed, struct SwsContext **bg_sws_ctx) {
+    AVFrame *frame = slot->frame;
+    // 编码器可能仍持有该槽位上一帧的引用
+    int ret = av_frame_make_writable(frame);
+    if (ret < 0){
+        av_log(NULL, AV_LOG_ERROR, "error: %s\n", av_err2str(ret));
+        return ret;
+    }
+
+    if (sequential_input(p)) {
+        ret = convert_packed_background(packed, frame, bg_sws_ctx);
+    } else if (p->pack) {
+        ret = load_packed_background(p, i, packed, frame, bg_sws_ctx);
+    } else {
+        ret = load_background(p, i, frame, bg_sws_ctx);
+    }
+    if (ret < 0) {
+        return ret;
+    }
+
+    // 转换阶段据此判断背景是否与上一帧相同
+    slot->background = p->yuv_blend ? 0 : hash_frame(frame);
+
+    // 只在各层的包围盒内混合
+    int layers = p->scene->render(frame, i, &slot->dirty);
+    if (layers) {
+        av_log(NULL, AV_LOG_DEBUG, "%d layers, %zu dirty rects in %d\n", layers, slot->dirty.size(), i);
+    }
+    return 0;
+}
+
+// 读取叠加阶段，多个线程按原子计数领取帧序号
+static void render_worker(Pipeline *p) {
+    struct SwsContext *bg_sws_ctx = NULL;
+    AVFrame *packed = av_frame_alloc();
+    if (!packed) {
+        pipeline_fail(p);
+        return;
+    }
+    try {
+        while (!p->failed) {
+            int i;
+            bool end = false;
+            if (sequential_input(p)) {
+                std::lock_guard<std::mutex> lock(p->stream_lock);
+                if (p->stream_end) {
+                    break;
+                }
+                i = p->next++;
+                int ret = p->stream ? pack_stream_read(p->stream, packed) : dec_input_read(p->video, packed);
+                if (ret == AVERROR_EOF) {
+                    // 只有读到结尾的线程放结束标记，之后的线程不再领取序号
+                    p->stream_end = end = true;
+                } else if (ret < 0) {
+                    pipeline_fail(p);
+                    break;
+                }
+            } else {
+                i = p->next.fetch_add(1);
+                if (i >= p->total) {
+                    break;
+                }
+            }
+            FrameSlot *slot = p->render_ring->begin_put(i);
+            if (!slot) {
+                break;
+            }
+            // 视频背景沿用源时间戳，其余按帧序号
+            int64_t pts = p->video && !end ? packed->pts : i;
+            slot->end = end;
+            if (!end && render_frame(p, i, slot, packed, &bg_sws_ctx) < 0) {
+                pipeline_fail(p);
+                break;
+            }
+            slot->frame->pts = pts;
+            p->render_ring->end_put(i);
+            if (end) {
+                break;
+            }
+        }
+    } catch (const std::exception &e) {
+        av_log(NULL, AV_LOG_ERROR, "render failed: %s\n", e.what());
+        pipeline_fail(p);
+    }
+    sws_freeContext(bg_sws_ctx);
+    av_frame_free(&packed);
+}
+
+// 部分转换的条带按 16 行对齐。色度下采样的滤波会读到改动区域上下几行，
+// 所以改动区域先向两侧各扩 16 行再对齐；转换时两侧再多转换 16 行并丢弃，条带边缘的滤波与整帧转换相同
+#define BAND_ALIGN 16
+#define BAND_MARGIN 16
+
+// 只转换部分行时使用：先把带边距的条带转换到 scratch，再拷贝条带本身，转换上下文按条带高度缓存
+struct BandConverter {
+    AVFrame *scratch = nullptr;
+    std::map<int, struct SwsContext *> contexts;
+
+    ~BandConverter() {
+        for (auto &entry: contexts) {
+            sws_freeContext(entry.second);
+        }
+        av_frame_free(&scratch);
+    }
+};
+
+// 新旧两帧改动区域影响的行（含滤波半径），对齐后合并为互不相交的条带
+static void dirty_bands(const std::vector<SceneRect> &before, const std::vector<SceneRect> &after, int height,
+                        std::vector<std::pair<int, int>> *bands) {
+    bands->clear();
+    for (const std::vector<SceneRect> *rects: {&before, &after}) {
+        for (const SceneRect &rect: *rects) {
+            int y0 = std::max(rect.y - BAND_MARGIN, 0) / BAND_ALIGN * BAND_ALIGN;
+            int y1 = std::min((rect.y + rect.height + BAND_MARGIN + BAND_ALIGN - 1) / BAND_ALIGN * BAND_ALIGN, height);
+            bands->emplace_back(y0, y1);
+        }
+    }
+    std::sort(bands->begin(), bands->end());
+    size_t n = 0;
+    for (const auto &band: *bands) {
+        if (n && band.first <= (*bands)[n - 1].second) {
+            (*bands)[n - 1].second = std::max((*bands)[n - 1].second, band.second);
+        } else {
+            (*bands)[n++] = band;
+        }
+    }
+    bands->resize(n);
+}
+
+// 拷贝 YUV420P 的 rows 行，起始行为偶数
+static void copy_rows(AVFrame *dst, int dst_y, const AVFrame *src, int src_y, int rows) {
+    for (int plane = 0; plane < 3; plane++) {
+        int shift = plane ? 1 : 0;
+        int bytes = (dst->width + shift) >> shift;
+        int n = (rows + shift) >> shift;
+        uint8_t *d = dst->data[plane] + (dst_y >> shift) * dst->linesize[plane];
+        const uint8_t *s = src->data[plane] + (src_y >> shift) * src->linesize[plane];
+        for (int y = 0; y < n; y++) {
+            memcpy(d + y * dst->linesize[plane], s + y * src->linesize[plane], bytes);
+        }
+    }
+}
+
+// 把 in 的 [y0, y1) 行转换到 out 的同一位置
+static int convert_band(BandConverter *c, const AVFrame *in, AVFrame *out, int y0, int y1) {
+    int ys = std::max(0, y0 - BAND_MARGIN);
+    int ye = std::min(in->height, y1 + BAND_MARGIN);
+    struct SwsContext *&sws_ctx = c->contexts[ye - ys];
+    if (!sws_ctx) {
+        sws_ctx = sws_getContext(in->width, ye - ys, (AVPixelFormat) in->format,
+                                 out->width, ye - ys, (AVPixelFormat) out->format,
+                                 SWS_BICUBIC, NULL, NULL, NULL);
+        if (!sws_ctx) {
+            av_log(NULL, AV_LOG_ERROR, "Could not initialize the conversion context\n");
+            return AVERROR(EINVAL);
+        }
+    }
+    const uint8_t *src[4] = {in->data[0] + ys * in->linesize[0]};
+    sws_scale(sws_ctx, src, in->linesize, 0, ye - ys, c->scratch->data, c->scratch->linesize);
+    copy_rows(out, y0, c->scratch, y0 - ys, y1 - y0);
+    return 0;
+}
+
+// 转换阶段，按序号把 RGB24 帧转为编码器像素格式。背景与上一帧相同时，
+// 沿用上一帧的输出，只转换新旧改动区域所在的行，其余行直接拷贝
+static void convert_worker(Pipeline *p, struct SwsContext *sws_ctx) {
+    BandConverter bands;
+    // 上一帧输出的引用，编码器同样只读它
+    AVFrame *last = av_frame_alloc();
+    uint64_t last_background = 0;
+    std::vector<SceneRect> last_dirty;
+    std::vector<std::pair<int, int>> rows;
+    if (!last) {
+        pipeline_fail(p);
+        return;
+    }
+
+    for (int i = 0; i < p->total; i++) {
+        FrameSlot *in = p->render_ring->begin_take(i);
+        FrameSlot *out = in ? p->convert_ring->begin_put(i) : nullptr;
+        if (!out) {
+            break;
+        }
+        out->end = in->end;
+        out->dirty = in->dirty;
+        out->background = in->background;
+        if (!in->end) {
+            int ret = av_frame_make_writable(out->frame);
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "error: %s\n", av_err2str(ret));
+                pipeline_fail(p);
+                break;
+            }
+            int height = in->frame->height;
+            bool reuse = last->buf[0] && in->background && in->background == last_background
+                         && out->frame->format == AV_PIX_FMT_YUV420P && !(height & 1);
+            if (reuse && !bands.scratch) {
+                bands.scratch = av_frame_alloc();
+                ret = bands.scratch ? 0 : AVERROR(ENOMEM);
+                if (ret >= 0) {
+                    bands.scratch->format = out->frame->format;
+                    bands.scratch->width = out->frame->width;
+                    bands.scratch->height = out->frame->height;
+                    ret = av_frame_get_buffer(bands.scratch, 0);
+                }
+            }
+
+            int converted = 0;
+            if (reuse) {
+                int y = 0;
+                dirty_bands(last_dirty, in->dirty, height, &rows);
+                for (const auto &band: rows) {
+                    if (ret < 0) {
+                        break;
+                    }
+                    copy_rows(out->frame, y, last, y, band.first - y);
+                    ret = convert_band(&bands, in->frame, out->frame, band.first, band.second);
+                    converted += band.second - band.first;
+                    y = band.second;
+                }
+                copy_rows(out->frame, y, last, y, height - y);
+            } else {
+                // 格式转换
+                sws_scale(sws_ctx, (const uint8_t * const *)in->frame->data, in->frame->linesize, 0, height,
+                          out->frame->data, out->frame->linesize);
+                converted = height;
+            }
+            av_frame_unref(last);
+            if (ret >= 0) {
+                ret = av_frame_ref(last, out->frame);
+            }
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "error: %s\n", av_err2str(ret));
+                pipeline_fail(p);
+                break;
+            }
+            last_background = in->background;
+            last_dirty = in->dirty;
+            out->frame->pts = in->frame->pts;
+
+            av_log(NULL, AV_LOG_DEBUG, "convert %d: %d/%d rows%s\n", i, converted, height,
+                   reuse ? ", background unchanged" : "");
+            p->convert_frames++;
+            p->convert_rows += converted;
+            p->total_rows += height;
+            if (reuse) {
+                p->convert_reused++;
+                p->convert_reused_rows += converted;
+                p->reused_total_rows += height;
+            }
+        }
+        p->convert_ring->end_put(i);
+        p->render_ring->end_take(i);
+        if (out->end) {
+            break;
+        }
+    }
+    av_frame_free(&last);
+}
+
+// output.mp4 mpeg4 %03d.png||%03d.bmp||background.y4m||background.raw||-||fifo||input.mp4 352 288 overlay.png test.json||test.ptrk
+//   [--input-format rgb24|rgba|yuv420p] [--input-size 352x288] [--decode-threads 0] [--decode-thread-type auto] [--layer logo.png:logo.json] [--scene scene.txt] [--angle-precision 0.1] [--rotate-cache 360] [--rotate-cache-mb 256] [--bg-cache 64] [--bg-cache-mb 256] [--blend-kernel auto] [--blend-domain rgb|yuv] [--workers 8] [--queue-depth 16] [--prefetch 16] [encoder options] [--faststart 1] [--start-number 1] [--shard 1000]
 int main(int argc, char* argv[]) {
 
     char *dst, *codecname, *src, *overlay_image, *position_json_file;
     int width, height, ret, i;
-    struct SwsContext *sws_ctx;
-    AVPacket *pkt;
-    AVFrame *src_frame, *dst_frame;
-    FILE *f;
-    AVCodecContext *ctx;
+    struct SwsContext *sws_ctx = NULL;
+    AVPacket *pkt = NULL;
+    Muxer *mux = NULL;
+    AVCodecContext *ctx = NULL;
     const AVCodec* codec;
+    OrderedRing<FrameSlot> *out_ring;
+
+    // 旋转缓存参数
+    double angle_precision = 0;
+    size_t cache_entries = 360;
+    size_t cache_bytes = (size_t) 256 << 20;
+    // 第一层为位置参数中的叠加图与位置文件，其余由 --layer image:positions 与 --scene 给出
+    std::unique_ptr<Scene> scene;
+    std::vector<std::string> layer_args;
+    const char *scene_file = NULL;
+    // 背景去重缓存，条目数或内存上限为 0 时关闭
+    size_t bg_cache_entries = 64;
+    size_t bg_cache_bytes = (size_t) 256 << 20;
+    std::unique_ptr<FrameCache> bg_cache;
+    const char *blend_kernel = "auto";
+    // yuv: 背景直接转为 YUV420P，叠加图只在其包围盒内混合
+    bool yuv_blend = false;
 
-    std::string json;
-    std::map<int, Position> positions;
+    // 流水线参数，队列深度为 0 时取工作线程数的两倍
+    int workers = std::max(1u, std::thread::hardware_concurrency());
+    int queue_depth = 0;
+    // 预读深度，0 为不预读
+    int prefetch_depth = 16;
+    Prefetcher *prefetch = NULL;
+    // y4m/raw 单文件背景
+    PackReader *pack = NULL;
+    // 标准输入或管道：y4m，或按 --input-format 与 --input-size 读原始帧
+    PackStream *stream = NULL;
+    // 视频文件背景，解码后直接叠加再编码
+    DecInput *video = NULL;
+    // 视频背景的源时间基与上一帧的编码时间戳
+    AVRational video_time_base = {0, 1};
+    int64_t last_pts = AV_NOPTS_VALUE;
+    DecOptions dec_opts;
+    const char *input_format = NULL;
+    const char *input_size = NULL;
+    bool fps_given = false;
+    Pipeline pipeline;
+
+    EncOptions enc_opts;
+    AVDictionary *enc_dict = NULL;
+    MuxOptions mux_opts;
+    SeqOptions seq_opts;
+    FrameSeq *seq = NULL;
+    enc_options_init(&enc_opts);
+    mux_options_init(&mux_opts);
+    seq_options_init(&seq_opts);
+    dec_options_init(&dec_opts);
 
     av_log_set_level(AV_LOG_DEBUG);
     // 输入参数
@@ -64,6 +588,116 @@ int main(int argc, char* argv[]) {
     overlay_image = argv[6];
     position_json_file = argv[7];
 
+    // 可选参数
+    for (int k = 8; k < argc; k += 2) {
+        if (k + 1 >= argc) {
+            av_log(NULL, AV_LOG_ERROR, "missing value for %s\n", argv[k]);
+            goto err;
+        }
+        if (strcmp(argv[k], "--angle-precision") == 0) {
+            angle_precision = atof(argv[k + 1]);
+        } else if (strcmp(argv[k], "--rotate-cache") == 0) {
+            cache_entries = strtoul(argv[k + 1], NULL, 10);
+        } else if (strcmp(argv[k], "--rotate-cache-mb") == 0) {
+            cache_bytes = (size_t) strtoul(argv[k + 1], NULL, 10) << 20;
+        } else if (strcmp(argv[k], "--bg-cache") == 0) {
+            bg_cache_entries = strtoul(argv[k + 1], NULL, 10);
+        } else if (strcmp(argv[k], "--bg-cache-mb") == 0) {
+            bg_cache_bytes = (size_t) strtoul(argv[k + 1], NULL, 10) << 20;
+        } else if (strcmp(argv[k], "--layer") == 0) {
+            layer_args.push_back(argv[k + 1]);
+        } else if (strcmp(argv[k], "--scene") == 0) {
+            scene_file = argv[k + 1];
+        } else if (strcmp(argv[k], "--blend-kernel") == 0) {
+            blend_kernel = argv[k + 1];
+        } else if (strcmp(argv[k], "--blend-domain") == 0) {
+            yuv_blend = strcmp(argv[k + 1], "yuv") == 0;
+        } else if (strcmp(argv[k], "--workers") == 0) {
+            workers = std::max(1, atoi(argv[k + 1]));
+        } else if (strcmp(argv[k], "--queue-depth") == 0) {
+            queue_depth = atoi(argv[k + 1]);
+        } else if (strcmp(argv[k], "--prefetch") == 0) {
+            prefetch_depth = std::max(0, atoi(argv[k + 1]));
+        } else if (strcmp(argv[k], "--input-format") == 0) {
+            input_format = argv[k + 1];
+        } else if (strcmp(argv[k], "--input-size") == 0) {
+            input_size = argv[k + 1];
+        } else {
+            // 其余参数交给编码器、封装器、帧序列与视频解码器
+            fps_given |= strcmp(argv[k], "--fps") == 0;
+            ret = strncmp(argv[k], "--", 2) == 0 ? enc_options_parse(&enc_opts, argv[k] + 2, argv[k + 1]) : 0;
+            if (ret == 0 && strncmp(argv[k], "--", 2) == 0) {
+                ret = mux_options_parse(&mux_opts, argv[k] + 2, argv[k + 1]);
+            }
+            if (ret == 0 && strncmp(argv[k], "--", 2) == 0) {
+                ret = seq_options_parse(&seq_opts, argv[k] + 2, argv[k + 1]);
+            }
+            if (ret == 0 && strncmp(argv[k], "--", 2) == 0) {
+                ret = dec_options_parse(&dec_opts, argv[k] + 2, argv[k + 1]);
+            }
+            if (ret == 0) {
+                av_log(NULL, AV_LOG_ERROR, "unknown option: %s\n", argv[k]);
+                goto err;
+            } else if (ret < 0) {
+                goto err;
+            }
+        }
+    }
+    if (queue_depth <= 0) {
+        queue_depth = workers * 2;
+    }
+
+    if (blend_init(blend_kernel) < 0) {
+        goto err;
+    }
+    av_log(NULL, AV_LOG_INFO, "blend kernel: %s\n", blend_kernel_name());
+
+    // 单文件、y4m 流与视频文件在未指定 --fps 时沿用记录的帧率
+    {
+        struct stat st;
+        bool is_stream = strcmp(src, "-") == 0 || input_format
+                         || (stat(src, &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode)));
+        if (is_stream) {
+            // 原始帧默认与输出同样大小
+            int in_width = width, in_height = height;
+            if (input_size && av_parse_video_size(&in_width, &in_height, input_size) < 0) {
+                av_log(NULL, AV_LOG_ERROR, "invalid input size: %s\n", input_size);
+                goto err;
+            }
+            AVPixelFormat in_format = input_format ? av_get_pix_fmt(input_format) : AV_PIX_FMT_NONE;
+            if (input_format && in_format == AV_PIX_FMT_NONE) {
+                av_log(NULL, AV_LOG_ERROR, "invalid input format: %s\n", input_format);
+                goto err;
+            }
+            ret = pack_stream_open(&stream, src, in_width, in_height, in_format);
+            if (ret < 0) {
+                goto err;
+            }
+            if (!fps_given) {
+                enc_opts.framerate = pack_stream_info(stream)->frame_rate;
+            }
+        } else if (pack_probe(src)) {
+            ret = pack_reader_open(&pack, src);
+            if (ret < 0) {
+                goto err;
+            }
+            if (!fps_given) {
+                enc_opts.framerate = pack_reader_info(pack)->frame_rate;
+            }
+        } else if (!strchr(src, '%') && stat(src, &st) == 0 && S_ISREG(st.st_mode)) {
+            // 不是帧序列模板的普通文件当作视频解码
+            ret = dec_input_open(&video, src, &dec_opts);
+            if (ret < 0) {
+                goto err;
+            }
+            const AVStream *vst = dec_input_stream(video);
+            AVRational rate = vst->avg_frame_rate.num ? vst->avg_frame_rate : vst->r_frame_rate;
+            if (!fps_given && rate.num > 0 && rate.den > 0) {
+                enc_opts.framerate = rate;
+            }
+        }
+    }
+
     // 查找编码器
     codec = avcodec_find_encoder_by_name(codecname);
     if (!codec) {
@@ -79,53 +713,41 @@ int main(int argc, char* argv[]) {
     // 设置编码器参数
     ctx->width = width;
     ctx->height = height;
-    ctx->bit_rate = 500000;
-    ctx->time_base = (AVRational){1, 25};
-    ctx->framerate = (AVRational){25, 1};
-    ctx->gop_size = 10;
-    ctx->max_b_frames = 1;
     ctx->pix_fmt = AV_PIX_FMT_YUV420P;
-    if (codec->id == AV_CODEC_ID_H264) {
-        av_opt_set(ctx->priv_data, "preset", "slow", 0);
-    }
-
-    // 编码器与编码器上下文绑定到一起
-    ret = avcodec_open2(ctx, codec, NULL);
+    ret = enc_options_apply(&enc_opts, ctx, &enc_dict);
     if (ret < 0) {
-        av_log(ctx, AV_LOG_ERROR, "Don't open codec: %s \n", av_err2str(ret));
         goto err;
     }
+    // 视频背景保留源时间戳。编码器时间基的分母有上限（mpeg4 为 65535），
+    // 源时间基（如 mpegts 的 1/90000）超出时改用 1/帧率，时间戳在编码阶段换算
+    if (video) {
+        video_time_base = dec_input_stream(video)->time_base;
+        av_reduce(&ctx->time_base.num, &ctx->time_base.den, video_time_base.num, video_time_base.den, INT_MAX);
+        if (ctx->time_base.den > 65535) {
+            av_reduce(&ctx->time_base.num, &ctx->time_base.den, enc_opts.framerate.den, enc_opts.framerate.num, 65535);
+        }
+    }
 
-    // 创建输出文件
-    f = fopen(dst, "wb");
-    if (!f) {
-        av_log(NULL, AV_LOG_ERROR, "Don't open file: %s\n", dst);
+    // 创建输出文件，容器格式由扩展名决定
+    ret = mux_alloc(&mux, dst, &mux_opts);
+    if (ret < 0) {
         goto err;
     }
-
-    // 创建AVFrame
-    src_frame = av_frame_alloc();
-    dst_frame = av_frame_alloc();
-    if (!src_frame || !dst_frame) {
-        fprintf(stderr, "Could not allocate video frame\n");
-        exit(1);
+    if (mux_need_global_header(mux)) {
+        ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
     }
 
-    src_frame->format = AV_PIX_FMT_RGB24;
-    src_frame->width  = ctx->width;
-    src_frame->height = ctx->height;
-    ret = av_frame_get_buffer(src_frame, 0);
+    // 编码器与编码器上下文绑定到一起
+    ret = avcodec_open2(ctx, codec, &enc_dict);
     if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Could not allocate the video frame\n");
+        av_log(ctx, AV_LOG_ERROR, "Don't open codec: %s \n", av_err2str(ret));
         goto err;
     }
+    enc_options_log(ctx, enc_dict);
 
-    dst_frame->width = ctx->width;
-    dst_frame->height = ctx->height;
-    dst_frame->format = ctx->pix_fmt;
-    ret = av_frame_get_buffer(dst_frame, 0);
+    // 写入文件头，之后的数据由写线程落盘
+    ret = mux_start(mux, ctx);
     if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Could not allocate the video frame\n");
         goto err;
     }
 
@@ -136,85 +758,172 @@ int main(int argc, char* argv[]) {
         goto err;
     }
 
-    // 用于格式转换
-    sws_ctx = sws_getContext(ctx->width, ctx->height, AV_PIX_FMT_RGB24,
-                                         ctx->width, ctx->height, ctx->pix_fmt,
-                                         SWS_BICUBIC, NULL, NULL, NULL);
-    if (!sws_ctx) {
-        av_log(NULL, AV_LOG_ERROR, "Could not initialize the conversion context\n");
+    // 用于格式转换，YUV 域混合不需要 RGB24 中间帧
+    if (!yuv_blend) {
+        sws_ctx = sws_getContext(ctx->width, ctx->height, AV_PIX_FMT_RGB24,
+                                 ctx->width, ctx->height, ctx->pix_fmt,
+                                 SWS_BICUBIC, NULL, NULL, NULL);
+        if (!sws_ctx) {
+            av_log(NULL, AV_LOG_ERROR, "Could not initialize the conversion context\n");
+            goto err;
+        }
+    }
+
+    // 创建各阶段循环复用的AVFrame
+    pipeline.render_ring.reset(new OrderedRing<FrameSlot>(queue_depth));
+    ret = alloc_ring_frames(pipeline.render_ring.get(), yuv_blend ? ctx->pix_fmt : AV_PIX_FMT_RGB24,
+                            ctx->width, ctx->height);
+    if (ret >= 0 && !yuv_blend) {
+        pipeline.convert_ring.reset(new OrderedRing<FrameSlot>(queue_depth));
+        ret = alloc_ring_frames(pipeline.convert_ring.get(), ctx->pix_fmt, ctx->width, ctx->height);
+    }
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Could not allocate the video frame\n");
         goto err;
     }
+    out_ring = yuv_blend ? pipeline.render_ring.get() : pipeline.convert_ring.get();
 
     Magick::InitializeMagick(nullptr);
-    json = readStringsFromFile(position_json_file);
-    positions = parsePositions(json.c_str());
-
-    // 从%03d.png图片获取视频内容
-    char img_filename[20];
-    i = 0;
-    while (true) {
-        sprintf(img_filename, src, i + 1);
-
-        // 文件不存在
-        if (access(img_filename, F_OK) != 0) {
-            break;
+    // 各层的位置文件与叠加图只加载一次，旋转结果按图片与角度缓存
+    scene.reset(new Scene(angle_precision, cache_entries, cache_bytes, yuv_blend));
+    if (!scene->addLayer(overlay_image, position_json_file)) {
+        goto err;
+    }
+    for (const std::string &arg: layer_args) {
+        // 以最后一个冒号分隔叠加图与位置文件
+        size_t colon = arg.rfind(':');
+        if (colon == std::string::npos || colon == 0 || colon + 1 == arg.size()) {
+            av_log(NULL, AV_LOG_ERROR, "invalid layer, expected image:positions: %s\n", arg.c_str());
+            goto err;
+        }
+        if (!scene->addLayer(arg.substr(0, colon).c_str(), arg.c_str() + colon + 1)) {
+            goto err;
         }
+    }
+    if (scene_file && !scene->addLayers(scene_file)) {
+        goto err;
+    }
+    scene->open();
 
-        ret = av_frame_make_writable(src_frame);
-        if (ret < 0){
-            av_log(NULL, AV_LOG_ERROR, "error: %s\n", av_err2str(ret));
+    // 从%03d.png图片获取视频内容，一次读取目录得到全部帧；单文件按帧号直接读取，流与视频文件顺序读取
+    if (!pack && !stream && !video) {
+        ret = seq_open(&seq, src, &seq_opts);
+        if (ret < 0) {
+            goto err;
+        }
+        ret = seq_scan(seq);
+        if (ret < 0) {
             goto err;
         }
+    }
+    if (seq && prefetch_depth > 0) {
+        ret = prefetch_start(&prefetch, seq, prefetch_depth);
+        if (ret < 0) {
+            goto err;
+        }
+    }
 
-        Magick::Image background;
-        background.read(img_filename); // 替换为您的背景图像文件名
+    pipeline.scene = scene.get();
+    // 只有图片序列经过 GraphicsMagick 解码，单文件与流输入不需要去重
+    if (seq && bg_cache_entries > 0 && bg_cache_bytes > 0) {
+        bg_cache.reset(new FrameCache(bg_cache_entries, bg_cache_bytes));
+        pipeline.bg_cache = bg_cache.get();
+    }
+    pipeline.yuv_blend = yuv_blend;
+    pipeline.seq = seq;
+    pipeline.prefetch = prefetch;
+    pipeline.pack = pack;
+    pipeline.stream = stream;
+    pipeline.video = video;
+    if (stream || video) {
+        pipeline.total = INT_MAX;
+        av_log(NULL, AV_LOG_INFO, "pipeline: streaming from %s, %d workers, queue depth %d\n",
+               src, workers, queue_depth);
+    } else {
+        pipeline.total = pack ? pack_reader_info(pack)->count : seq_count(seq);
+        av_log(NULL, AV_LOG_INFO, "pipeline: %d frames, %d workers, queue depth %d\n",
+               pipeline.total, workers, queue_depth);
+    }
 
-        Magick::Image overlay;
-        overlay.read(overlay_image); // 替换为您的要旋转的图像文件名
-        overlay.backgroundColor(Magick::Color("#ffffffff"));
+    for (int k = 0; k < workers; k++) {
+        pipeline.threads.emplace_back(render_worker, &pipeline);
+    }
+    if (!yuv_blend) {
+        pipeline.threads.emplace_back(convert_worker, &pipeline, sws_ctx);
+    }
 
-        if (positions.count(i) == 1) {
-            printf("position use by %d\n", i);
-            Position &position = positions[i];
-            composite_to_frame_plus(&background, &overlay, position.offsetX, position.offsetY, position.degrees);
+    // 编码阶段，按序号取帧保证pts顺序
+    for (i = 0; i < pipeline.total; i++) {
+        FrameSlot *slot = out_ring->begin_take(i);
+        if (!slot) {
+            break;
+        }
+        if (slot->end) {
+            out_ring->end_take(i);
+            break;
         }
-        image_to_frame(&background, src_frame);
-
-        // 格式转换
-        sws_scale(sws_ctx, (const uint8_t * const *)src_frame->data, src_frame->linesize, 0, ctx->height,
-                  dst_frame->data, dst_frame->linesize);
-
-        // 设置pts
-        dst_frame->pts = i;
 
+        // pts 已由读取阶段设置，视频背景的源时间戳换算到编码器时间基，
+        // 时间基变粗后重合的时间戳接在上一帧之后
+        if (video) {
+            slot->frame->pts = av_rescale_q(slot->frame->pts, video_time_base, ctx->time_base);
+            if (last_pts != AV_NOPTS_VALUE && slot->frame->pts <= last_pts) {
+                slot->frame->pts = last_pts + 1;
+            }
+            last_pts = slot->frame->pts;
+        }
         // 编码
-        ret = encode(ctx, dst_frame, pkt, f);
+        ret = encode(ctx, slot->frame, pkt, mux);
+        out_ring->end_take(i);
         if (ret == -1) {
-            goto err;
+            pipeline_fail(&pipeline);
+            break;
         }
-        i++;
     }
+    pipeline_join(&pipeline);
+    if (pipeline.failed) {
+        goto err;
+    }
+
+    encode(ctx, NULL, pkt, mux);
 
-    encode(ctx, NULL, pkt, f);
+    scene->log();
+    if (bg_cache) {
+        size_t lookups = bg_cache->hits() + bg_cache->misses();
+        av_log(NULL, AV_LOG_INFO, "background cache: hits %zu, misses %zu, hit rate %.1f%%, evictions %zu, "
+               "entries %zu, %zu bytes\n", bg_cache->hits(), bg_cache->misses(),
+               lookups ? 100.0 * bg_cache->hits() / lookups : 0.0, bg_cache->evictions(),
+               bg_cache->entries(), bg_cache->bytes());
+    }
+    if (!yuv_blend) {
+        av_log(NULL, AV_LOG_INFO, "convert: %d frames, %d with unchanged background, rows converted %.1f%% per frame, "
+               "%.1f%% on unchanged backgrounds\n",
+               pipeline.convert_frames, pipeline.convert_reused,
+               pipeline.total_rows ? 100.0 * pipeline.convert_rows / pipeline.total_rows : 0.0,
+               pipeline.reused_total_rows ? 100.0 * pipeline.convert_reused_rows / pipeline.reused_total_rows : 0.0);
+    }
 
 err:
+    if (!pipeline.threads.empty()) {
+        pipeline_fail(&pipeline);
+        pipeline_join(&pipeline);
+    }
     if (sws_ctx) {
         sws_freeContext(sws_ctx);
     }
     if (ctx) {
         avcodec_free_context(&ctx);
     }
-    if (src_frame) {
-        av_frame_free(&src_frame);
-    }
-    if (dst_frame) {
-        av_frame_free(&dst_frame);
-    }
+    av_dict_free(&enc_dict);
+    enc_options_free(&enc_opts);
     if (pkt) {
         av_packet_free(&pkt);
     }
-    if (f) {
-        fclose(f);
-    }
+    mux_close(&mux);
+    prefetch_stop(&prefetch);
+    pack_reader_close(&pack);
+    pack_stream_close(&stream);
+    dec_input_close(&video);
+    seq_free(&seq);
     return 0;
-}
\ No newline at end of file
+}
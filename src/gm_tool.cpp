@@ -1,6 +1,10 @@
 #include "gm_tool.h"
 
 #include <Magick++.h>
+#include <algorithm>
+#include <vector>
+
+#include "blend_tool.h"
 
 extern "C" {
 #include <libavutil/frame.h>
@@ -11,44 +15,91 @@ double to_radians(double degrees) {
 }
 
 void image_to_frame(Magick::Image *image, AVFrame *frame) {
-    int width = image->columns();
-    int height = image->rows();
-    // 获取每个像素并填充到AVFrame
+    int width = std::min<int>(image->columns(), frame->width);
+    int height = std::min<int>(image->rows(), frame->height);
+    // 行跨度紧凑时整幅导出，否则按 linesize 逐行导出
+    if (frame->linesize[0] == width * 3) {
+        image->write(0, 0, width, height, "RGB", Magick::CharPixel, frame->data[0]);
+        return;
+    }
     for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            Magick::ColorRGB color = image->pixelColor(x, y);
-            int offset = (y * width + x) * 3;
-            frame->data[0][offset] = static_cast<uint8_t>(color.red() * 255);
-            frame->data[0][offset + 1] = static_cast<uint8_t>(color.green() * 255);
-            frame->data[0][offset + 2] = static_cast<uint8_t>(color.blue() * 255);
-        }
+        image->write(0, y, width, 1, "RGB", Magick::CharPixel, frame->data[0] + y * frame->linesize[0]);
     }
 }
 
+// 像素缓存中 PixelPacket 的内存排列对应的像素格式
+#if QuantumDepth == 8 && defined(WORDS_BIGENDIAN)
+#define PIXEL_PACKET_FMT AV_PIX_FMT_RGBA
+#elif QuantumDepth == 8
+#define PIXEL_PACKET_FMT AV_PIX_FMT_BGRA
+#elif QuantumDepth == 16 && defined(WORDS_BIGENDIAN)
+#define PIXEL_PACKET_FMT AV_PIX_FMT_RGBA64BE
+#elif QuantumDepth == 16
+#define PIXEL_PACKET_FMT AV_PIX_FMT_BGRA64LE
+#endif
+
+int image_to_yuv_frame(Magick::Image *image, struct SwsContext **sws_ctx, AVFrame *frame) {
+    // 与 image_to_frame 相同的几何：按左上角对齐，超出帧的部分裁掉，不足的部分保持原样，不缩放
+    int width = std::min<int>(image->columns(), frame->width);
+    int height = std::min<int>(image->rows(), frame->height);
+#ifdef PIXEL_PACKET_FMT
+    // 不透明度通道在转到无 alpha 的格式时被丢弃
+    const uint8_t *src[1] = {(const uint8_t *) image->getConstPixels(0, 0, width, height)};
+    const int src_linesize[1] = {width * (int) sizeof(Magick::PixelPacket)};
+    enum AVPixelFormat src_fmt = PIXEL_PACKET_FMT;
+#else
+    std::vector<uint8_t> rgb((size_t) width * height * 3);
+    image->write(0, 0, width, height, "RGB", Magick::CharPixel, rgb.data());
+    const uint8_t *src[1] = {rgb.data()};
+    const int src_linesize[1] = {width * 3};
+    enum AVPixelFormat src_fmt = AV_PIX_FMT_RGB24;
+#endif
+    if (!src[0]) {
+        return -1;
+    }
+    *sws_ctx = sws_getCachedContext(*sws_ctx, width, height, src_fmt,
+                                    width, height, (enum AVPixelFormat) frame->format,
+                                    SWS_BICUBIC, NULL, NULL, NULL);
+    if (!*sws_ctx) {
+        return -1;
+    }
+    sws_scale(*sws_ctx, src, src_linesize, 0, height, frame->data, frame->linesize);
+    return 0;
+}
+
 void composite_to_frame(Magick::Image *background, Magick::Image *overlay, int offsetX, int offsetY, double degrees){
     overlay->rotate(degrees); // 角度以度为单位
     background->composite(*overlay, offsetX, offsetY, Magick::OverCompositeOp);
 }
 
-void composite_to_frame_plus(Magick::Image *background, Magick::Image *overlay, int offsetX, int offsetY, double degrees) {
-    Magick::Geometry size = overlay->size();
-    int width = size.width();
-    int height = size.height();
-
+void overlay_placement(int width, int height, double degrees, double *dx, double *dy) {
     double degrees_360 = fmod(degrees, 360);
     double degrees_90 = fmod(degrees, 90);
     double radians = to_radians(degrees_90);
     double cosa = cos(radians);
     double sina = sin(radians);
 
-    double x, y;
     if (degrees_360 <= 90 || (degrees_360 >= 180 && degrees_360 <= 270)) {
-        x = offsetX - (sina * height + cosa * width) / 2;
-        y = offsetY - (cosa * height + sina * width) / 2;
+        *dx = -(sina * height + cosa * width) / 2;
+        *dy = -(cosa * height + sina * width) / 2;
     } else {
-        x = offsetX - (sina * width + cosa * height) / 2;
-        y = offsetY - (cosa * width + sina * height) / 2;
+        *dx = -(sina * width + cosa * height) / 2;
+        *dy = -(cosa * width + sina * height) / 2;
     }
+}
+
+void composite_to_frame_plus(Magick::Image *background, Magick::Image *overlay, int offsetX, int offsetY, double degrees) {
+    Magick::Geometry size = overlay->size();
+    double dx, dy;
+    overlay_placement(size.width(), size.height(), degrees, &dx, &dy);
+    composite_to_frame(background, overlay, offsetX + dx, offsetY + dy, degrees);
+}
+
+void composite_to_yuv_frame(AVFrame *frame, const RotatedOverlay *overlay, int offsetX, int offsetY) {
+    blend_yuva_to_yuv420p(frame, overlay->yuva, (int) (offsetX + overlay->dx), (int) (offsetY + overlay->dy));
+}
 
-    composite_to_frame(background, overlay, x, y, degrees);
+void composite_to_frame_plus(AVFrame *frame, const RotatedOverlay *overlay, int offsetX, int offsetY) {
+    blend_rgba_to_rgb24(frame, overlay->rgba.data(), overlay->width, overlay->height, overlay->width * 4,
+                        (int) (offsetX + overlay->dx), (int) (offsetY + overlay->dy));
 }
@@ -0,0 +1,160 @@
+#include "hash_tool.h"
+
+#include <string.h>
+
+#include <libavutil/common.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+
+#define PRIME1 UINT64_C(11400714785074694791)
+#define PRIME2 UINT64_C(14029467366897019727)
+#define PRIME3 UINT64_C(1609587929392839161)
+#define PRIME4 UINT64_C(9650029242287828579)
+#define PRIME5 UINT64_C(2870177450012600261)
+
+static inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// 按小端读取，与平台的对齐要求无关
+static inline uint64_t read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input) {
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+static inline uint64_t merge64(uint64_t acc, uint64_t v) {
+    acc ^= round64(0, v);
+    return acc * PRIME1 + PRIME4;
+}
+
+void hash_init(HashState *s, uint64_t seed) {
+    memset(s, 0, sizeof(*s));
+    s->seed = seed;
+    s->v[0] = seed + PRIME1 + PRIME2;
+    s->v[1] = seed + PRIME2;
+    s->v[2] = seed;
+    s->v[3] = seed - PRIME1;
+}
+
+// 四路累加器各处理 8 字节
+static const uint8_t *consume(uint64_t v[4], const uint8_t *p, const uint8_t *end) {
+    while (p + 32 <= end) {
+        v[0] = round64(v[0], read64(p));
+        v[1] = round64(v[1], read64(p + 8));
+        v[2] = round64(v[2], read64(p + 16));
+        v[3] = round64(v[3], read64(p + 24));
+        p += 32;
+    }
+    return p;
+}
+
+void hash_update(HashState *s, const void *data, size_t size) {
+    const uint8_t *p = data;
+    const uint8_t *end = p + size;
+    s->total += size;
+
+    if (s->buffered + size < 32) {
+        memcpy(s->buf + s->buffered, p, size);
+        s->buffered += (int) size;
+        return;
+    }
+    if (s->buffered) {
+        int fill = 32 - s->buffered;
+        memcpy(s->buf + s->buffered, p, fill);
+        consume(s->v, s->buf, s->buf + 32);
+        p += fill;
+        s->buffered = 0;
+    }
+    p = consume(s->v, p, end);
+    if (p < end) {
+        s->buffered = (int) (end - p);
+        memcpy(s->buf, p, s->buffered);
+    }
+}
+
+uint64_t hash_final(const HashState *s) {
+    uint64_t h;
+    if (s->total >= 32) {
+        h = rotl(s->v[0], 1) + rotl(s->v[1], 7) + rotl(s->v[2], 12) + rotl(s->v[3], 18);
+        for (int k = 0; k < 4; k++) {
+            h = merge64(h, s->v[k]);
+        }
+    } else {
+        h = s->seed + PRIME5;
+    }
+    h += s->total;
+
+    const uint8_t *p = s->buf;
+    const uint8_t *end = p + s->buffered;
+    for (; p + 8 <= end; p += 8) {
+        h ^= round64(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t) read32(p) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed) {
+    HashState s;
+    hash_init(&s, seed);
+    hash_update(&s, data, size);
+    return hash_final(&s);
+}
+
+uint64_t hash_frame(const AVFrame *frame) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    int layout[3] = {frame->width, frame->height, frame->format};
+    HashState s;
+    hash_init(&s, 0);
+    hash_update(&s, layout, sizeof(layout));
+    if (!desc) {
+        return hash_final(&s);
+    }
+
+    int planes = av_pix_fmt_count_planes(frame->format);
+    for (int plane = 0; plane < planes; plane++) {
+        int bytes = av_image_get_linesize(frame->format, frame->width, plane);
+        int rows = frame->height;
+        if ((plane == 1 || plane == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB)) {
+            rows = AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h);
+        }
+        const uint8_t *row = frame->data[plane];
+        for (int y = 0; y < rows; y++, row += frame->linesize[plane]) {
+            hash_update(&s, row, bytes);
+        }
+    }
+    return hash_final(&s);
+}
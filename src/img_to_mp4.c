@@ -2,10 +2,20 @@
 #include <libavutil/opt.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/cpu.h>
+#include <libavutil/file.h>
+#include <libavutil/time.h>
 #include <libswscale/swscale.h>
 #include <unistd.h>
 
-static int encode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, FILE *out) {
+#include "enc_tool.h"
+#include "mux_tool.h"
+#include "pack_tool.h"
+#include "seq_tool.h"
+#include "prefetch_tool.h"
+#include "pool_tool.h"
+
+static int encode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, Muxer *mux) {
     int ret = avcodec_send_frame(ctx, frame);
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR, "Failed to send frame to encoder!\n");
@@ -18,27 +28,253 @@ static int encode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, FILE *out)
         } else if (ret < 0) {
             return -1;
         }
-        fwrite(pkt->data, 1, pkt->size, out);
-        av_packet_unref(pkt);
+        // 包的引用交给封装器
+        if (mux_write(mux, pkt) < 0) {
+            return -1;
+        }
     }
 end:
     return 0;
 }
 
-// output.mp4 mpeg4 %03d.png||%03d.bmp 352 288
+#define MAX_IMAGE_DECODERS 4
+
+// 每种图片编码保留一个解码器，整个序列复用，不再逐帧探测和打开。每个解码线程各有一份
+typedef struct ImageDecoders {
+    AVCodecContext *ctx[MAX_IMAGE_DECODERS];
+    int count;
+    AVPacket *pkt;
+    const AVOutputFormat *image2;
+    AVFrame *frame;
+    struct SwsContext *sws_ctx;
+    int passthrough;
+} ImageDecoders;
+
+static int image_decoders_init(ImageDecoders *dec) {
+    dec->count = 0;
+    dec->image2 = av_guess_format("image2", NULL, NULL);
+    dec->pkt = av_packet_alloc();
+    dec->frame = av_frame_alloc();
+    return dec->pkt && dec->frame ? 0 : AVERROR(ENOMEM);
+}
+
+static void image_decoders_free(ImageDecoders *dec) {
+    for (int k = 0; k < dec->count; k++) {
+        avcodec_free_context(&dec->ctx[k]);
+    }
+    dec->count = 0;
+    av_packet_free(&dec->pkt);
+    av_frame_free(&dec->frame);
+    sws_freeContext(dec->sws_ctx);
+    dec->sws_ctx = NULL;
+}
+
+// 先按扩展名判断（与 image2 的规则相同），无法判断时才探测文件内容
+static enum AVCodecID guess_image_codec(const ImageDecoders *dec, const char *filename,
+                                        const uint8_t *data, size_t size) {
+    enum AVCodecID id = dec->image2 ? av_guess_codec(dec->image2, NULL, filename, NULL, AVMEDIA_TYPE_VIDEO)
+                                    : AV_CODEC_ID_NONE;
+    if (id != AV_CODEC_ID_NONE) {
+        return id;
+    }
+
+    AVIOContext *pb = prefetch_avio_alloc(data, size);
+    AVFormatContext *fmt_ctx = avformat_alloc_context();
+    if (pb && fmt_ctx) {
+        fmt_ctx->pb = pb;
+        if (avformat_open_input(&fmt_ctx, filename, NULL, NULL) >= 0) {
+            if (avformat_find_stream_info(fmt_ctx, NULL) >= 0 && fmt_ctx->nb_streams > 0) {
+                id = fmt_ctx->streams[0]->codecpar->codec_id;
+            }
+            avformat_close_input(&fmt_ctx);
+        }
+    }
+    avformat_free_context(fmt_ctx);
+    prefetch_avio_free(&pb);
+    return id;
+}
+
+static AVCodecContext *get_image_decoder(ImageDecoders *dec, enum AVCodecID id) {
+    for (int k = 0; k < dec->count; k++) {
+        if (dec->ctx[k]->codec_id == id) {
+            return dec->ctx[k];
+        }
+    }
+    if (dec->count == MAX_IMAGE_DECODERS) {
+        av_log(NULL, AV_LOG_ERROR, "Too many image codecs in one sequence\n");
+        return NULL;
+    }
+
+    const AVCodec *img_codec = avcodec_find_decoder(id);
+    if (!img_codec) {
+        av_log(NULL, AV_LOG_ERROR, "Could not find image codec\n");
+        return NULL;
+    }
+    AVCodecContext *img_ctx = avcodec_alloc_context3(img_codec);
+    if (!img_ctx) {
+        av_log(NULL, AV_LOG_ERROR, "Could not allocate image codec context\n");
+        return NULL;
+    }
+    // 单线程解码，每个包送入后立即得到一帧
+    img_ctx->thread_count = 1;
+    int ret = avcodec_open2(img_ctx, img_codec, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Could not open image codec: %s\n", av_err2str(ret));
+        avcodec_free_context(&img_ctx);
+        return NULL;
+    }
+    dec->ctx[dec->count++] = img_ctx;
+    return img_ctx;
+}
+
+// 把整个图片文件作为一个包送入解码器（image2 分离器也是这样读包的）
+static int decode_image(ImageDecoders *dec, const char *filename, const uint8_t *data, size_t size, AVFrame *frame) {
+    if (size > INT_MAX) {
+        return AVERROR(EINVAL);
+    }
+    AVCodecContext *img_ctx = get_image_decoder(dec, guess_image_codec(dec, filename, data, size));
+    if (!img_ctx) {
+        return AVERROR_DECODER_NOT_FOUND;
+    }
+
+    dec->pkt->data = (uint8_t *) data;
+    dec->pkt->size = (int) size;
+    int ret = avcodec_send_packet(img_ctx, dec->pkt);
+    av_packet_unref(dec->pkt);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Could not send image packet to decoder: %s\n", av_err2str(ret));
+        return ret;
+    }
+    ret = avcodec_receive_frame(img_ctx, frame);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Could not receive image frame from decoder %s: %s\n", filename, av_err2str(ret));
+        return ret;
+    }
+    return 0;
+}
+
+// 并行解码：工作线程按序号读取、解码并转换为编码器格式，编码线程按序号取帧
+typedef struct DecodeJobs {
+    const FrameSeq *seq;
+    Prefetcher *prefetch;
+    PackReader *pack;           // 输入为 y4m/raw 单文件时按帧号直接读取，不经过图片解码器
+    ImageDecoders *decoders;    // 每个工作线程一份
+    AVFrame **frames;           // 每个槽位一帧，缓冲区在编码器释放后复用
+    int width;
+    int height;
+    enum AVPixelFormat pix_fmt;
+} DecodeJobs;
+
+// 格式与尺寸一致时直接交出解码出的帧，否则转换到槽位自己的缓冲区
+static int convert_image(const DecodeJobs *jobs, ImageDecoders *dec, AVFrame *out) {
+    AVFrame *in = dec->frame;
+    if (in->format == jobs->pix_fmt && in->width == jobs->width && in->height == jobs->height) {
+        av_frame_unref(out);
+        av_frame_move_ref(out, in);
+        dec->passthrough++;
+        return 0;
+    }
+
+    dec->sws_ctx = sws_getCachedContext(dec->sws_ctx, in->width, in->height, in->format,
+                                        jobs->width, jobs->height, jobs->pix_fmt,
+                                        SWS_BICUBIC, NULL, NULL, NULL);
+    if (!dec->sws_ctx) {
+        av_log(NULL, AV_LOG_ERROR, "Could not initialize the conversion context\n");
+        return AVERROR(EINVAL);
+    }
+    // 编码器仍持有上一帧的引用时换一块新缓冲区，避免拷贝
+    if (!out->buf[0] || out->format != jobs->pix_fmt || !av_frame_is_writable(out)) {
+        av_frame_unref(out);
+        out->format = jobs->pix_fmt;
+        out->width = jobs->width;
+        out->height = jobs->height;
+        int ret = av_frame_get_buffer(out, 0);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Could not allocate the video frame\n");
+            return ret;
+        }
+    }
+    // 格式转换
+    sws_scale(dec->sws_ctx, (const uint8_t * const *)in->data, in->linesize, 0, in->height,
+              out->data, out->linesize);
+    av_frame_unref(in);
+    return 0;
+}
+
+static int decode_job(void *opaque, int worker, int index, int slot) {
+    DecodeJobs *jobs = opaque;
+    ImageDecoders *dec = &jobs->decoders[worker];
+    if (jobs->pack) {
+        int ret = pack_reader_read(jobs->pack, index, dec->frame);
+        return ret < 0 ? ret : convert_image(jobs, dec, jobs->frames[slot]);
+    }
+
+    char filename[4096];
+    int ret = seq_path(jobs->seq, index, filename, sizeof(filename));
+    if (ret < 0) {
+        return ret;
+    }
+
+    // 取得整个文件的内容，预读时已在内存中
+    if (jobs->prefetch) {
+        PrefetchBuf *buf;
+        ret = prefetch_get(jobs->prefetch, index, &buf);
+        if (ret < 0) {
+            return ret;
+        }
+        ret = decode_image(dec, filename, buf->data, buf->size, dec->frame);
+        prefetch_release(buf);
+    } else {
+        uint8_t *map;
+        size_t size;
+        ret = av_file_map(filename, &map, &size, 0, NULL);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Could not open image file %s: %s\n", filename, av_err2str(ret));
+            return ret;
+        }
+        ret = decode_image(dec, filename, map, size, dec->frame);
+        av_file_unmap(map, size);
+    }
+    if (ret < 0) {
+        return ret;
+    }
+    return convert_image(jobs, dec, jobs->frames[slot]);
+}
+
+// output.mp4 mpeg4 %03d.png||%03d.bmp||all.y4m||all.raw 352 288 [encoder options] [--faststart 1] [--start-number 1] [--shard 1000] [--prefetch 16] [--workers 8] [--queue-depth 16]
 int main(int argc, char* argv[]) {
 
     char *dst, *codecname, *src;
     int width, height, ret, i;
-    struct SwsContext *sws_ctx;
-    AVPacket *pkt;
-    AVFrame *src_frame, *dst_frame;
-    FILE *f;
-    AVCodecContext *ctx;
+    AVPacket *pkt = NULL;
+    Muxer *mux = NULL;
+    AVCodecContext *ctx = NULL;
     const AVCodec* codec;
-    AVFormatContext *fmt_ctx = NULL;
+    EncOptions enc_opts;
+    AVDictionary *enc_dict = NULL;
+    MuxOptions mux_opts;
+    SeqOptions seq_opts;
+    FrameSeq *seq = NULL;
+    // y4m/raw 单文件输入
+    PackReader *pack = NULL;
+    int fps_given = 0;
+    int total = 0;
+    // 预读深度，0 为不预读
+    int prefetch_depth = 16;
+    Prefetcher *prefetch = NULL;
+    // 解码线程数与在途帧数上限，队列深度为 0 时取线程数的两倍
+    int workers = av_cpu_count();
+    int queue_depth = 0;
+    JobPool *pool = NULL;
+    DecodeJobs jobs = {0};
+    int64_t start_time = 0;
+    double elapsed;
+    int passthrough = 0, nb_decoders = 0;
 
     av_log_set_level(AV_LOG_DEBUG);
+    enc_options_init(&enc_opts);
+    mux_options_init(&mux_opts);
+    seq_options_init(&seq_opts);
 
     // 输入参数
     if (argc < 6) {
@@ -52,6 +288,49 @@ int main(int argc, char* argv[]) {
     width = atoi(argv[4]);
     height = atoi(argv[5]);
 
+    // 编码器、封装与帧序列参数 --name value
+    for (int k = 6; k < argc; k += 2) {
+        if (k + 1 >= argc) {
+            av_log(NULL, AV_LOG_ERROR, "missing value for %s\n", argv[k]);
+            goto err;
+        }
+        if (strcmp(argv[k], "--prefetch") == 0) {
+            prefetch_depth = FFMAX(0, atoi(argv[k + 1]));
+            continue;
+        } else if (strcmp(argv[k], "--workers") == 0) {
+            workers = FFMAX(1, atoi(argv[k + 1]));
+            continue;
+        } else if (strcmp(argv[k], "--queue-depth") == 0) {
+            queue_depth = atoi(argv[k + 1]);
+            continue;
+        }
+        fps_given |= strcmp(argv[k], "--fps") == 0;
+        ret = strncmp(argv[k], "--", 2) == 0 ? enc_options_parse(&enc_opts, argv[k] + 2, argv[k + 1]) : 0;
+        if (ret == 0 && strncmp(argv[k], "--", 2) == 0) {
+            ret = mux_options_parse(&mux_opts, argv[k] + 2, argv[k + 1]);
+        }
+        if (ret == 0 && strncmp(argv[k], "--", 2) == 0) {
+            ret = seq_options_parse(&seq_opts, argv[k] + 2, argv[k + 1]);
+        }
+        if (ret == 0) {
+            av_log(NULL, AV_LOG_ERROR, "unknown option: %s\n", argv[k]);
+            goto err;
+        } else if (ret < 0) {
+            goto err;
+        }
+    }
+
+    // 单文件输入在未指定 --fps 时沿用文件记录的帧率
+    if (pack_probe(src)) {
+        ret = pack_reader_open(&pack, src);
+        if (ret < 0) {
+            goto err;
+        }
+        if (!fps_given) {
+            enc_opts.framerate = pack_reader_info(pack)->frame_rate;
+        }
+    }
+
     // 查找编码器
     codec = avcodec_find_encoder_by_name(codecname);
     if (!codec) {
@@ -67,44 +346,32 @@ int main(int argc, char* argv[]) {
     // 设置编码器参数
     ctx->width = width;
     ctx->height = height;
-    ctx->bit_rate = 500000;
-    ctx->time_base = (AVRational){1, 25};
-    ctx->framerate = (AVRational){25, 1};
-    ctx->gop_size = 10;
-    ctx->max_b_frames = 1;
     ctx->pix_fmt = AV_PIX_FMT_YUV420P;
-    if (codec->id == AV_CODEC_ID_H264) {
-        av_opt_set(ctx->priv_data, "preset", "slow", 0);
-    }
-
-    // 编码器与编码器上下文绑定到一起
-    ret = avcodec_open2(ctx, codec, NULL);
+    ret = enc_options_apply(&enc_opts, ctx, &enc_dict);
     if (ret < 0) {
-        av_log(ctx, AV_LOG_ERROR, "Don't open codec: %s \n", av_err2str(ret));
         goto err;
     }
 
-    // 创建输出文件
-    f = fopen(dst, "wb");
-    if (!f) {
-        av_log(NULL, AV_LOG_ERROR, "Don't open file: %s\n", dst);
+    // 创建输出文件，容器格式由扩展名决定
+    ret = mux_alloc(&mux, dst, &mux_opts);
+    if (ret < 0) {
         goto err;
     }
+    if (mux_need_global_header(mux)) {
+        ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
 
-    // 创建AVFrame
-    src_frame = av_frame_alloc();
-    dst_frame = av_frame_alloc();
-    if (!src_frame || !dst_frame) {
-        av_log(NULL, AV_LOG_ERROR, "NO MEMRORY\n");
+    // 编码器与编码器上下文绑定到一起
+    ret = avcodec_open2(ctx, codec, &enc_dict);
+    if (ret < 0) {
+        av_log(ctx, AV_LOG_ERROR, "Don't open codec: %s \n", av_err2str(ret));
         goto err;
     }
+    enc_options_log(ctx, enc_dict);
 
-    dst_frame->width = ctx->width;
-    dst_frame->height = ctx->height;
-    dst_frame->format = ctx->pix_fmt;
-    ret = av_frame_get_buffer(dst_frame, 0);
+    // 写入文件头，之后的数据由写线程落盘
+    ret = mux_start(mux, ctx);
     if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Could not allocate the video frame\n");
         goto err;
     }
 
@@ -115,126 +382,120 @@ int main(int argc, char* argv[]) {
         goto err;
     }
 
-    // 用于格式转换
-    sws_ctx = sws_getContext(ctx->width, ctx->height, AV_PIX_FMT_RGB24,
-                             ctx->width, ctx->height, ctx->pix_fmt,
-                             SWS_BICUBIC, NULL, NULL, NULL);
-    if (!sws_ctx) {
-        av_log(NULL, AV_LOG_ERROR, "Could not initialize the conversion context\n");
-        goto err;
-    }
-
-    // 从%03d.png图片获取视频内容
-    char img_filename[20];
-    i = 0;
-    while (1) {
-        sprintf(img_filename, src, i + 1);
-
-        // 文件不存在
-        if (access(img_filename, F_OK) != 0) {
-            break;
-        }
-
-        // 打开图片
-        ret = avformat_open_input(&fmt_ctx, img_filename, NULL, NULL);
+    // 从%03d.png图片获取视频内容，一次读取目录得到全部帧；单文件按帧号直接读取
+    if (pack) {
+        total = pack_reader_info(pack)->count;
+    } else {
+        ret = seq_open(&seq, src, &seq_opts);
         if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Could not open image file: %s\n", av_err2str(ret));
             goto err;
         }
-
-        // 查找图片流信息
-        ret = avformat_find_stream_info(fmt_ctx, NULL);
+        ret = seq_scan(seq);
         if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Could not find stream information in image file: %s\n", av_err2str(ret));
-            goto err;
-        }
-
-        // 查找图片解码器
-        const AVCodec *img_codec = avcodec_find_decoder(fmt_ctx->streams[0]->codecpar->codec_id);
-        if (!img_codec) {
-            av_log(NULL, AV_LOG_ERROR, "Could not find image codec\n");
             goto err;
         }
-
-        // 创建图片解码器上下文
-        AVCodecContext *img_ctx = avcodec_alloc_context3(img_codec);
-        if (!img_ctx) {
-            av_log(NULL, AV_LOG_ERROR, "Could not allocate image codec context\n");
-            goto err;
-        }
-
-        // 复制参数到解码器上下文
-        ret = avcodec_parameters_to_context(img_ctx, fmt_ctx->streams[0]->codecpar);
+        total = seq_count(seq);
+    }
+    if (seq && prefetch_depth > 0) {
+        ret = prefetch_start(&prefetch, seq, prefetch_depth);
         if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Could not copy codec parameters to image codec context: %s\n", av_err2str(ret));
             goto err;
         }
+    }
 
-        // 打开图片解码器
-        ret = avcodec_open2(img_ctx, img_codec, NULL);
+    // 每个工作线程一组解码器，每个槽位一帧
+    if (queue_depth <= 0) {
+        queue_depth = workers * 2;
+    }
+    jobs.seq = seq;
+    jobs.prefetch = prefetch;
+    jobs.pack = pack;
+    jobs.width = ctx->width;
+    jobs.height = ctx->height;
+    jobs.pix_fmt = ctx->pix_fmt;
+    jobs.decoders = av_calloc(workers, sizeof(*jobs.decoders));
+    jobs.frames = av_calloc(queue_depth, sizeof(*jobs.frames));
+    if (!jobs.decoders || !jobs.frames) {
+        av_log(NULL, AV_LOG_ERROR, "NO MEMRORY\n");
+        goto err;
+    }
+    for (int k = 0; k < workers; k++) {
+        ret = image_decoders_init(&jobs.decoders[k]);
         if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Could not open image codec: %s\n", av_err2str(ret));
             goto err;
         }
-
-        // 读取图片帧
-        ret = av_read_frame(fmt_ctx, pkt);
-        if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Could not read image frame: %s\n", av_err2str(ret));
+    }
+    for (int k = 0; k < queue_depth; k++) {
+        jobs.frames[k] = av_frame_alloc();
+        if (!jobs.frames[k]) {
+            av_log(NULL, AV_LOG_ERROR, "NO MEMRORY\n");
             goto err;
         }
+    }
+    av_log(NULL, AV_LOG_INFO, "decode: %d frames, %d workers, queue depth %d\n",
+           total, workers, queue_depth);
 
-        // 解码图片帧
-        ret = avcodec_send_packet(img_ctx, pkt);
-        if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Could not send image packet to decoder: %s\n", av_err2str(ret));
-            goto err;
-        }
-        ret = avcodec_receive_frame(img_ctx, src_frame);
-        if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Could not receive image frame from decoder: %s\n", av_err2str(ret));
+    start_time = av_gettime_relative();
+    ret = pool_start(&pool, workers, queue_depth, total, decode_job, &jobs);
+    if (ret < 0) {
+        goto err;
+    }
+
+    // 编码阶段，按序号取帧保证pts顺序
+    for (i = 0; i < total; i++) {
+        int slot = pool_take(pool, i);
+        if (slot < 0) {
             goto err;
         }
-
-        // 格式转换
-        sws_scale(sws_ctx, (const uint8_t * const *)src_frame->data, src_frame->linesize, 0, ctx->height,
-                  dst_frame->data, dst_frame->linesize);
+        AVFrame *frame = jobs.frames[slot];
 
         // 设置pts
-        dst_frame->pts = i;
+        frame->pts = i;
 
         // 编码
-        ret = encode(ctx, dst_frame, pkt, f);
+        ret = encode(ctx, frame, pkt, mux);
+        pool_release(pool, i);
         if (ret == -1) {
             goto err;
         }
-
-        // 释放资源
-        avcodec_free_context(&img_ctx);
-        avformat_close_input(&fmt_ctx);
-        i++;
     }
 
-    encode(ctx, NULL, pkt, f);
+    encode(ctx, NULL, pkt, mux);
+
+    elapsed = (av_gettime_relative() - start_time) / 1000000.0;
+    for (int k = 0; k < workers; k++) {
+        passthrough += jobs.decoders[k].passthrough;
+        nb_decoders += jobs.decoders[k].count;
+    }
+    av_log(NULL, AV_LOG_INFO, "img_to_mp4: %d frames in %.3f s (%.1f fps), %d decoders, %d frames without conversion\n",
+           i, elapsed, elapsed > 0 ? i / elapsed : 0, nb_decoders, passthrough);
 
 err:
-    if (sws_ctx) {
-        sws_freeContext(sws_ctx);
+    // 先停掉工作线程与预读线程，再释放它们使用的资源
+    pool_stop(&pool);
+    prefetch_stop(&prefetch);
+    pack_reader_close(&pack);
+    if (jobs.decoders) {
+        for (int k = 0; k < workers; k++) {
+            image_decoders_free(&jobs.decoders[k]);
+        }
+        av_free(jobs.decoders);
+    }
+    if (jobs.frames) {
+        for (int k = 0; k < queue_depth; k++) {
+            av_frame_free(&jobs.frames[k]);
+        }
+        av_free(jobs.frames);
     }
     if (ctx) {
         avcodec_free_context(&ctx);
     }
-    if (src_frame) {
-        av_frame_free(&src_frame);
-    }
-    if (dst_frame) {
-        av_frame_free(&dst_frame);
-    }
+    av_dict_free(&enc_dict);
+    enc_options_free(&enc_opts);
     if (pkt) {
         av_packet_free(&pkt);
     }
-    if (f) {
-        fclose(f);
-    }
+    mux_close(&mux);
+    seq_free(&seq);
     return 0;
 }
\ No newline at end of file
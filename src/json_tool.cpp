@@ -1,28 +1,249 @@
-#include <map>
 #include "json_tool.h"
 
-#include "rapidjson/document.h"
-
-std::map<int, Position> parsePositions(const char *json) {
-    std::map<int, Position> result;
-    rapidjson::Document doc;
-    doc.Parse(json);
-    if (doc.IsObject()) {
-        for (rapidjson::Value::ConstMemberIterator it = doc.MemberBegin(); it!= doc.MemberEnd(); ++it) {
-            int key = std::stoi(it->name.GetString());
-            const rapidjson::Value& value = it->value;
-            Position pos;
-            if (value.HasMember("offsetX")) {
-                pos.offsetX = value["offsetX"].GetInt();
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sys/mman.h>
+
+#include "rapidjson/error/en.h"
+#include "rapidjson/filereadstream.h"
+#include "rapidjson/reader.h"
+
+PositionTrack::~PositionTrack() {
+    if (map_) {
+        munmap(map_, map_size_);
+    }
+}
+
+void PositionTrack::sync() {
+    present_ = presence_.data();
+    records_ = positions_.data();
+    frames_ = positions_.size();
+}
+
+static bool testBit(const std::vector<uint64_t> &bits, size_t i) {
+    return bits[i >> 6] & (UINT64_C(1) << (i & 63));
+}
+
+// 位图中 [begin, begin + n) 的位移到新位图的 [to, to + n)
+static std::vector<uint64_t> moveBits(const std::vector<uint64_t> &bits, size_t begin, size_t n, size_t to,
+                                      size_t size) {
+    std::vector<uint64_t> moved((size + 63) / 64);
+    for (size_t i = 0; i < n; i++) {
+        if (testBit(bits, begin + i)) {
+            moved[(to + i) >> 6] |= UINT64_C(1) << ((to + i) & 63);
+        }
+    }
+    return moved;
+}
+
+void PositionTrack::set(int frame, const Position &position) {
+    if (positions_.empty()) {
+        // 与二进制轨迹一样从第一个有位置的帧开始存放，帧号很大时前面的帧不占内存
+        first_ = frame;
+    } else if (frame < first_) {
+        // 帧号通常递增，偶尔更小时向前扩容，同样按倍数留出余量，最多扩到第 0 帧
+        size_t grow = std::min(std::max((size_t) (first_ - frame), positions_.size()), (size_t) first_);
+        size_t size = positions_.size();
+        positions_.insert(positions_.begin(), grow, Position{});
+        presence_ = moveBits(presence_, 0, size, grow, positions_.size());
+        first_ -= (int) grow;
+    }
+    size_t i = (size_t) (frame - first_);
+    if (i >= positions_.size()) {
+        // 按倍数扩容
+        size_t size = std::max(i + 1, positions_.size() * 2);
+        positions_.resize(size);
+        presence_.resize((size + 63) / 64);
+    }
+    uint64_t &word = presence_[i >> 6];
+    uint64_t bit = UINT64_C(1) << (i & 63);
+    if (!(word & bit)) {
+        word |= bit;
+        count_++;
+    }
+    positions_[i] = position;
+    sync();
+}
+
+void PositionTrack::shrink() {
+    // 去掉扩容时多出的首尾
+    size_t begin = 0, end = positions_.size();
+    while (end > 0 && !testBit(presence_, end - 1)) {
+        end--;
+    }
+    while (begin < end && !testBit(presence_, begin)) {
+        begin++;
+    }
+    if (begin > 0) {
+        presence_ = moveBits(presence_, begin, end - begin, 0, end - begin);
+        positions_.erase(positions_.begin(), positions_.begin() + begin);
+        first_ += (int) begin;
+    }
+    positions_.resize(end - begin);
+    positions_.shrink_to_fit();
+    presence_.resize((end - begin + 63) / 64);
+    presence_.shrink_to_fit();
+    sync();
+}
+
+size_t PositionTrack::bytes() const {
+    if (map_) {
+        return map_size_;
+    }
+    return positions_.capacity() * sizeof(Position) + presence_.capacity() * sizeof(uint64_t);
+}
+
+void PositionTrack::attach(void *map, size_t map_size, int first, size_t frames, size_t count,
+                           const uint64_t *present, const Position *records) {
+    if (map_) {
+        munmap(map_, map_size_);
+    }
+    positions_ = std::vector<Position>();
+    presence_ = std::vector<uint64_t>();
+    map_ = map;
+    map_size_ = map_size;
+    first_ = first;
+    frames_ = frames;
+    count_ = count;
+    present_ = present;
+    records_ = records;
+}
+
+// 根对象的每个成员是一帧：键为帧号，值为位置对象，位置对象中未知的成员（含嵌套）跳过
+class PositionHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, PositionHandler> {
+public:
+    explicit PositionHandler(PositionTrack *track) : track_(track) {}
+
+    bool StartObject() {
+        depth_++;
+        if (depth_ == 2) {
+            position_ = Position{0, 0, 0};
+        }
+        return true;
+    }
+
+    bool EndObject(rapidjson::SizeType) {
+        if (depth_ == 2) {
+            // 帧号跨度过大时数组分配失败，按解析错误返回
+            try {
+                track_->set(frame_, position_);
+            } catch (const std::bad_alloc &) {
+                error_ = "frame range too large";
+                return false;
+            }
+        }
+        depth_--;
+        field_ = nullptr;
+        return true;
+    }
+
+    bool StartArray() {
+        // 根必须是对象
+        if (depth_ == 0) {
+            return false;
+        }
+        depth_++;
+        return true;
+    }
+
+    bool EndArray(rapidjson::SizeType) {
+        depth_--;
+        return true;
+    }
+
+    bool Key(const char *str, rapidjson::SizeType length, bool) {
+        field_ = nullptr;
+        is_int_ = false;
+        if (depth_ == 1) {
+            auto result = std::from_chars(str, str + length, frame_);
+            if (result.ec != std::errc() || result.ptr != str + length || frame_ < 0) {
+                error_ = "invalid frame number";
+                return false;
             }
-            if (value.HasMember("offsetY")) {
-                pos.offsetY = value["offsetY"].GetInt();
+        } else if (depth_ == 2) {
+            if (length == 7 && memcmp(str, "offsetX", 7) == 0) {
+                int_field_ = &position_.offsetX;
+                is_int_ = true;
+            } else if (length == 7 && memcmp(str, "offsetY", 7) == 0) {
+                int_field_ = &position_.offsetY;
+                is_int_ = true;
+            } else if (length == 7 && memcmp(str, "degrees", 7) == 0) {
+                field_ = &position_.degrees;
             }
-            if (value.HasMember("degrees")) {
-                pos.degrees = value["degrees"].GetDouble();
+        }
+        return true;
+    }
+
+    bool Int(int i) { return Number(i); }
+    bool Uint(unsigned u) { return Number(u); }
+    bool Int64(int64_t i) { return Number((double) i); }
+    bool Uint64(uint64_t u) { return Number((double) u); }
+    bool Double(double d) { return Number(d); }
+
+    // 其余类型的值：根不是对象时失败，位置对象中的忽略
+    bool Default() {
+        return depth_ > 0;
+    }
+
+    const char *error() const { return error_; }
+
+private:
+    bool Number(double value) {
+        if (depth_ == 2) {
+            if (is_int_) {
+                *int_field_ = (int) value;
+            } else if (field_) {
+                *field_ = value;
             }
-            result[key] = pos;
         }
+        is_int_ = false;
+        field_ = nullptr;
+        return depth_ > 0;
+    }
+
+    PositionTrack *track_;
+    int depth_ = 0;
+    int frame_ = 0;
+    Position position_{};
+    double *field_ = nullptr;
+    int *int_field_ = nullptr;
+    bool is_int_ = false;
+    const char *error_ = nullptr;
+};
+
+template<typename Stream>
+static bool parse(Stream &stream, PositionTrack *track, const char *name) {
+    PositionHandler handler(track);
+    rapidjson::Reader reader;
+    rapidjson::ParseResult result = reader.Parse(stream, handler);
+    if (!result) {
+        std::cerr << "无法解析位置文件 " << name << ": "
+                  << (handler.error() ? handler.error() : rapidjson::GetParseError_En(result.Code()))
+                  << " (offset " << result.Offset() << ")" << std::endl;
+        return false;
     }
-    return result;
+    track->shrink();
+    return true;
+}
+
+bool loadPositions(const char *filename, PositionTrack *track) {
+    std::unique_ptr<FILE, int (*)(FILE *)> file(fopen(filename, "rb"), fclose);
+    if (!file) {
+        std::cerr << "无法打开文件: " << filename << std::endl;
+        return false;
+    }
+    // 每次读 64 KB，内存占用与文件大小无关
+    std::unique_ptr<char[]> buffer(new char[1 << 16]);
+    rapidjson::FileReadStream stream(file.get(), buffer.get(), 1 << 16);
+    return parse(stream, track, filename);
+}
+
+bool parsePositions(const char *json, PositionTrack *track) {
+    rapidjson::StringStream stream(json);
+    return parse(stream, track, "(string)");
 }
@@ -5,8 +5,14 @@
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/time.h>
 #include <libswscale/swscale.h>
 
+#include "conv_tool.h"
+#include "dec_tool.h"
+#include "out_tool.h"
+#include "seq_tool.h"
+
 // BMP 文件头定义
 #pragma pack(push, 1)
 typedef struct {
@@ -32,12 +38,12 @@ typedef struct {
 } BITMAPINFOHEADER;
 #pragma pack(pop)
 
-// 写入 BMP 文件
-void write_bmp(const char *filename, uint8_t *data, int width, int height) {
-    FILE *file = fopen(filename, "wb");
-    if (!file) {
-        perror("Failed to open file");
-        exit(EXIT_FAILURE);
+// 写入 BMP 文件，两个文件头与像素交给输出队列一次写出
+int write_bmp(OutWriter *out, const char *filename, uint8_t *data, int linesize, int width, int height) {
+    OutFile *file;
+    int ret = out_writer_get(out, (size_t) width * height * 3, &file);
+    if (ret < 0) {
+        return ret;
     }
 
     BITMAPFILEHEADER file_header;
@@ -61,37 +67,40 @@ void write_bmp(const char *filename, uint8_t *data, int width, int height) {
     info_header.biClrUsed = 0;
     info_header.biClrImportant = 0;
 
-    fwrite(&file_header, sizeof(BITMAPFILEHEADER), 1, file);
-    fwrite(&info_header, sizeof(BITMAPINFOHEADER), 1, file);
-    fwrite(data, width * height * 3, 1, file);
+    memcpy(file->header, &file_header, sizeof(BITMAPFILEHEADER));
+    memcpy(file->header + sizeof(BITMAPFILEHEADER), &info_header, sizeof(BITMAPINFOHEADER));
+    file->header_size = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+    // 缓冲区每行可能有对齐填充，逐行拷贝
+    for (int y = 0; y < height; y++) {
+        memcpy(file->data + (size_t) y * width * 3, data + y * linesize, width * 3);
+    }
+    file->size = (size_t) width * height * 3;
+
+    return out_writer_submit(out, file, filename);
+}
 
-    fclose(file);
+// 公共导出状态加小文件输出队列，RGB 缓冲区逐帧复用
+typedef struct BmpExporter {
+    Exporter base;
+    OutWriter *out;
+    AVFrame *rgb;
+} BmpExporter;
+
+// 返回输出队列关闭时报告的第一个写错误
+static int bmp_exporter_free(BmpExporter *ex) {
+    int ret = out_writer_close(&ex->out);
+    av_frame_free(&ex->rgb);
+    exporter_free(&ex->base);
+    return ret;
 }
 
-static int decode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, const char *filename) {
+static int decode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, BmpExporter *ex) {
     int ret = -1;
-    char buf[1024];
+    char buf[4096];
     ret = avcodec_send_packet(ctx, pkt);
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR, "failed to send frame to decode\n");
-        goto end;
-    }
-
-    frame->format = ctx->pix_fmt;
-    frame->width = ctx->width;
-    frame->height = ctx->height;
-    uint8_t *rgb_data = av_malloc(av_image_get_buffer_size(AV_PIX_FMT_RGB24, ctx->width, ctx->height, 1));
-    if (!rgb_data) {
-        fprintf(stderr, "Could not allocate RGB data buffer\n");
-        return 1;
-    }
-
-    struct SwsContext *sws_ctx = sws_getContext(ctx->width, ctx->height, ctx->pix_fmt,
-                                                ctx->width, ctx->height, AV_PIX_FMT_RGB24,
-                                                SWS_BILINEAR, NULL, NULL, NULL);
-    if (!sws_ctx) {
-        fprintf(stderr, "Could not initialize the conversion context\n");
-        return 1;
+        return 0;
     }
 
     while (ret >= 0) {
@@ -102,32 +111,43 @@ static int decode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, const char
             return -1;
         }
 
-        int rgb_linesize = ctx->width * 3;
-        uint8_t *rgb_data_ptr[1] = { rgb_data }; // 对于单平面格式，如 RGB24
-        const int dstStride[1] = { rgb_linesize };
-        sws_scale(sws_ctx, (const uint8_t *const *)frame->data, frame->linesize, 0,
-                  ctx->height, rgb_data_ptr, dstStride);
-
-        snprintf(buf, sizeof(buf), filename, ctx->frame_num);
+        // 按解码帧自身的宽高转换，分辨率变化时缓冲区与上下文随之重建
+        ret = conv_frame_alloc(ex->rgb, frame->width, frame->height, AV_PIX_FMT_RGB24);
+        if (ret < 0) {
+            return -1;
+        }
+        ret = conv_cache_convert(&ex->base.conv, frame, ex->rgb, SWS_BILINEAR);
+        if (ret < 0) {
+            return -1;
+        }
 
-        write_bmp(buf, rgb_data, ctx->width, ctx->height);
+        // 输出编号按解码器交出帧的顺序计数，帧线程的延迟与重排不影响编号
+        if (seq_output_path(ex->base.seq, ex->base.frames, buf, sizeof(buf)) < 0) {
+            return -1;
+        }
 
+        if (write_bmp(ex->out, buf, ex->rgb->data[0], ex->rgb->linesize[0], ex->rgb->width, ex->rgb->height) < 0) {
+            return -1;
+        }
 
-        if (pkt) {
-            av_packet_unref(pkt);
+        if (++ex->base.frames % 1000 == 0) {
+            exporter_log_rss(&ex->base);
         }
+        av_frame_unref(frame);
     }
-end:
     return 0;
 }
 
-// output.mp4 %03d.bmp
+// output.mp4 %03d.bmp [--start-number 1] [--shard 1000] [--decode-threads 0] [--decode-thread-type auto]
+//                      [--out-backend auto|uring|threads] [--out-depth 64] [--out-batch 16] [--out-threads 4] [--out-fsync none]
 int main(int argc, char **argv)
 {
     const char *src, *dst;
     int ret = 0;
-    AVFormatContext *fmt_ctx;
-    AVCodecContext *ctx;
+    AVFormatContext *fmt_ctx = NULL;
+    AVCodecContext *ctx = NULL;
+    AVFrame *frame = NULL;
+    AVPacket *pkt = NULL;
 
     av_log_set_level(AV_LOG_DEBUG);
 
@@ -138,6 +158,35 @@ int main(int argc, char **argv)
     src = argv[1];
     dst = argv[2];
 
+    // 帧序列、解码器与输出参数 --name value
+    SeqOptions seq_opts;
+    DecOptions dec_opts;
+    OutOptions out_opts;
+    BmpExporter ex = {0};
+    seq_options_init(&seq_opts);
+    dec_options_init(&dec_opts);
+    out_options_init(&out_opts);
+    for (int k = 3; k < argc; k += 2) {
+        if (k + 1 >= argc || strncmp(argv[k], "--", 2) != 0) {
+            av_log(NULL, AV_LOG_ERROR, "invalid option: %s\n", argv[k]);
+            exit(-1);
+        }
+        ret = seq_options_parse(&seq_opts, argv[k] + 2, argv[k + 1]);
+        if (ret == 0) {
+            ret = dec_options_parse(&dec_opts, argv[k] + 2, argv[k + 1]);
+        }
+        if (ret == 0) {
+            ret = out_options_parse(&out_opts, argv[k] + 2, argv[k + 1]);
+        }
+        if (ret <= 0) {
+            av_log(NULL, AV_LOG_ERROR, "invalid option: %s\n", argv[k]);
+            exit(-1);
+        }
+    }
+    if (seq_open(&ex.base.seq, dst, &seq_opts) < 0 || out_writer_open(&ex.out, &out_opts) < 0) {
+        exit(-1);
+    }
+
     // 打开多媒体文件
     ret = avformat_open_input(&fmt_ctx, src, NULL, NULL);
     if (ret < 0) {
@@ -149,6 +198,7 @@ int main(int argc, char **argv)
     int idx = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
     if (idx < 0) {
         av_log(fmt_ctx, AV_LOG_ERROR, "Does not include video stream!\n");
+        ret = idx;
         goto err;
     }
 
@@ -158,6 +208,7 @@ int main(int argc, char **argv)
     const AVCodec *codec = avcodec_find_decoder(in_stream->codecpar->codec_id);
     if (!codec) {
         av_log(NULL, AV_LOG_ERROR, "Could not find Codec\n");
+        ret = AVERROR_DECODER_NOT_FOUND;
         goto err;
     }
 
@@ -165,39 +216,62 @@ int main(int argc, char **argv)
     ctx = avcodec_alloc_context3(codec);
     if (!ctx) {
         av_log(NULL, AV_LOG_ERROR, "NO MEMEORY\n");
+        ret = AVERROR(ENOMEM);
         goto err;
     }
 
     avcodec_parameters_to_context(ctx, in_stream->codecpar);
 
+    // 线程参数必须在打开解码器之前设置
+    dec_options_apply(&dec_opts, ctx);
+
     // 解码器与解码器上下文绑定到一起
     ret = avcodec_open2(ctx, codec, NULL);
     if (ret < 0) {
         av_log(ctx, AV_LOG_ERROR, "Don't open codec: %s \n", av_err2str(ret));
         goto err;
     }
+    dec_options_log(ctx);
     
     // 创建AVFrame
-    AVFrame *frame = av_frame_alloc();
+    frame = av_frame_alloc();
     if (!frame) {
         av_log(NULL, AV_LOG_ERROR, "NO MEMORY!\n");
+        ret = AVERROR(ENOMEM);
+        goto err;
+    }
+
+    // RGB 输出帧，缓冲区在首帧解码后按实际宽高分配
+    ex.rgb = av_frame_alloc();
+    if (!ex.rgb) {
+        av_log(NULL, AV_LOG_ERROR, "NO MEMORY!\n");
+        ret = AVERROR(ENOMEM);
         goto err;
     }
 
     // 创建AVPacket
-    AVPacket *pkt = av_packet_alloc();
+    pkt = av_packet_alloc();
     if (!pkt) {
         av_log(NULL, AV_LOG_ERROR, "NO MEMORY!\n");
+        ret = AVERROR(ENOMEM);
         goto err;
     }
 
     // 从源多媒体文件中读到的视频数据到目的文件中
+    int64_t start = av_gettime_relative();
     while (av_read_frame(fmt_ctx, pkt) >= 0) {
-        if (pkt->stream_index == idx){
-            decode(ctx, frame, pkt, dst);
+        // 写文件出错时停止导出，之后的帧也写不出去
+        if (pkt->stream_index == idx && (ret = decode(ctx, frame, pkt, &ex)) < 0) {
+            av_packet_unref(pkt);
+            break;
         }
+        av_packet_unref(pkt);
+    }
+    if (ret >= 0) {
+        ret = decode(ctx, frame, NULL, &ex);
     }
-    decode(ctx, frame, NULL, dst);
+    dec_log_throughput(ctx, ex.base.frames, start);
+    exporter_log_rss(&ex.base);
 
 err:
     if (fmt_ctx) {
@@ -219,5 +293,10 @@ err:
         av_packet_free(&pkt);
         pkt = NULL;
     }
-    return 0;
+    // 还在队列里的文件写失败同样算导出失败
+    int out_ret = bmp_exporter_free(&ex);
+    if (out_ret < 0 && ret >= 0) {
+        ret = out_ret;
+    }
+    return ret < 0 ? -1 : 0;
 }
@@ -4,20 +4,30 @@
 
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/time.h>
 
-static void save_pic(unsigned char *buf, int linesize, int width, int height, char *name) {
-    FILE *f;
-    f = fopen(name, "wb");
-    fprintf(f, "P5\n%d %d\n%d\n", width, height, 255);
+#include "dec_tool.h"
+#include "out_tool.h"
+#include "seq_tool.h"
+
+// 文件头与紧凑排列的灰度行交给输出队列，一次写出
+static int save_pic(OutWriter *out, unsigned char *buf, int linesize, int width, int height, char *name) {
+    OutFile *file;
+    int ret = out_writer_get(out, (size_t) width * height, &file);
+    if (ret < 0) {
+        return ret;
+    }
+    file->header_size = snprintf((char *) file->header, sizeof(file->header), "P5\n%d %d\n%d\n", width, height, 255);
     for (int i = 0; i < height; ++i) {
-        fwrite(buf + i * linesize, 1, width, f);
+        memcpy(file->data + (size_t) i * width, buf + i * linesize, width);
     }
-    fclose(f);
+    file->size = (size_t) width * height;
+    return out_writer_submit(out, file, name);
 }
 
-static int decode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, const char *filename) {
+static int decode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, FrameSeq *seq, OutWriter *out, int64_t *frames) {
     int ret = -1;
-    char buf[1024];
+    char buf[4096];
     ret = avcodec_send_packet(ctx, pkt);
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR, "failed to send frame to decode\n");
@@ -31,23 +41,28 @@ static int decode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, const char
         } else if (ret < 0) {
             return -1;
         }
-        snprintf(buf, sizeof(buf), filename, ctx->frame_num);
-        save_pic(frame->data[0], frame->linesize[0], frame->width, frame->height, buf);
-        if (pkt) {
-            av_packet_unref(pkt);
+        // 输出编号按解码器交出帧的顺序计数，帧线程的延迟与重排不影响编号
+        if (seq_output_path(seq, (*frames)++, buf, sizeof(buf)) < 0) {
+            return -1;
+        }
+        if (save_pic(out, frame->data[0], frame->linesize[0], frame->width, frame->height, buf) < 0) {
+            return -1;
         }
     }
 end:
     return 0;
 }
 
-// output.mp4 %03d
+// output.mp4 %03d [--start-number 1] [--shard 1000] [--decode-threads 0] [--decode-thread-type auto]
+//                  [--out-backend auto|uring|threads] [--out-depth 64] [--out-batch 16] [--out-threads 4] [--out-fsync none]
 int main(int argc, char **argv)
 {
     const char *src, *dst;
     int ret = 0;
-    AVFormatContext *fmt_ctx;
-    AVCodecContext *ctx;
+    AVFormatContext *fmt_ctx = NULL;
+    AVCodecContext *ctx = NULL;
+    AVFrame *frame = NULL;
+    AVPacket *pkt = NULL;
 
     av_log_set_level(AV_LOG_DEBUG);
 
@@ -58,6 +73,36 @@ int main(int argc, char **argv)
     src = argv[1];
     dst = argv[2];
 
+    // 帧序列、解码器与输出参数 --name value
+    SeqOptions seq_opts;
+    DecOptions dec_opts;
+    OutOptions out_opts;
+    FrameSeq *seq = NULL;
+    OutWriter *out = NULL;
+    seq_options_init(&seq_opts);
+    dec_options_init(&dec_opts);
+    out_options_init(&out_opts);
+    for (int k = 3; k < argc; k += 2) {
+        if (k + 1 >= argc || strncmp(argv[k], "--", 2) != 0) {
+            av_log(NULL, AV_LOG_ERROR, "invalid option: %s\n", argv[k]);
+            exit(-1);
+        }
+        ret = seq_options_parse(&seq_opts, argv[k] + 2, argv[k + 1]);
+        if (ret == 0) {
+            ret = dec_options_parse(&dec_opts, argv[k] + 2, argv[k + 1]);
+        }
+        if (ret == 0) {
+            ret = out_options_parse(&out_opts, argv[k] + 2, argv[k + 1]);
+        }
+        if (ret <= 0) {
+            av_log(NULL, AV_LOG_ERROR, "invalid option: %s\n", argv[k]);
+            exit(-1);
+        }
+    }
+    if (seq_open(&seq, dst, &seq_opts) < 0 || out_writer_open(&out, &out_opts) < 0) {
+        exit(-1);
+    }
+
     // 打开多媒体文件
     ret = avformat_open_input(&fmt_ctx, src, NULL, NULL);
     if (ret < 0) {
@@ -69,6 +114,7 @@ int main(int argc, char **argv)
     int idx = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
     if (idx < 0) {
         av_log(fmt_ctx, AV_LOG_ERROR, "Does not include video stream!\n");
+        ret = idx;
         goto err;
     }
 
@@ -78,6 +124,7 @@ int main(int argc, char **argv)
     const AVCodec *codec = avcodec_find_decoder(in_stream->codecpar->codec_id);
     if (!codec) {
         av_log(NULL, AV_LOG_ERROR, "Could not find Codec\n");
+        ret = AVERROR_DECODER_NOT_FOUND;
         goto err;
     }
 
@@ -85,39 +132,54 @@ int main(int argc, char **argv)
     ctx = avcodec_alloc_context3(codec);
     if (!ctx) {
         av_log(NULL, AV_LOG_ERROR, "NO MEMEORY\n");
+        ret = AVERROR(ENOMEM);
         goto err;
     }
 
     avcodec_parameters_to_context(ctx, in_stream->codecpar);
 
+    // 线程参数必须在打开解码器之前设置
+    dec_options_apply(&dec_opts, ctx);
+
     // 解码器与解码器上下文绑定到一起
     ret = avcodec_open2(ctx, codec, NULL);
     if (ret < 0) {
         av_log(ctx, AV_LOG_ERROR, "Don't open codec: %s \n", av_err2str(ret));
         goto err;
     }
+    dec_options_log(ctx);
     
     // 创建AVFrame
-    AVFrame *frame = av_frame_alloc();
+    frame = av_frame_alloc();
     if (!frame) {
         av_log(NULL, AV_LOG_ERROR, "NO MEMORY!\n");
+        ret = AVERROR(ENOMEM);
         goto err;
     }
 
     // 创建AVPacket
-    AVPacket *pkt = av_packet_alloc();
+    pkt = av_packet_alloc();
     if (!pkt) {
         av_log(NULL, AV_LOG_ERROR, "NO MEMORY!\n");
+        ret = AVERROR(ENOMEM);
         goto err;
     }
 
     // 从源多媒体文件中读到的视频数据到目的文件中
+    int64_t frames = 0;
+    int64_t start = av_gettime_relative();
     while (av_read_frame(fmt_ctx, pkt) >= 0) {
-        if (pkt->stream_index == idx){
-            decode(ctx, frame, pkt, dst);
+        // 写文件出错时停止导出，之后的帧也写不出去
+        if (pkt->stream_index == idx && (ret = decode(ctx, frame, pkt, seq, out, &frames)) < 0) {
+            av_packet_unref(pkt);
+            break;
         }
+        av_packet_unref(pkt);
+    }
+    if (ret >= 0) {
+        ret = decode(ctx, frame, NULL, seq, out, &frames);
     }
-    decode(ctx, frame, NULL, dst);
+    dec_log_throughput(ctx, frames, start);
 
 err:
     if (fmt_ctx) {
@@ -139,5 +201,11 @@ err:
         av_packet_free(&pkt);
         pkt = NULL;
     }
-    return 0;
+    // 还在队列里的文件写失败同样算导出失败
+    int out_ret = out_writer_close(&out);
+    if (out_ret < 0 && ret >= 0) {
+        ret = out_ret;
+    }
+    seq_free(&seq);
+    return ret < 0 ? -1 : 0;
 }
@@ -4,84 +4,33 @@
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/time.h>
 #include <libswscale/swscale.h>
-// 引入libpng库
-#include <png.h>
 
-// 写入PNG文件
-void write_png(const char *filename, uint8_t *data, int width, int height) {
-    FILE *fp = fopen(filename, "wb");
-    if (!fp) {
-        perror("Failed to open file");
-        exit(EXIT_FAILURE);
-    }
-
-    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (!png_ptr) {
-        fclose(fp);
-        fprintf(stderr, "png_create_write_struct failed\n");
-        exit(EXIT_FAILURE);
-    }
-
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr) {
-        png_destroy_write_struct(&png_ptr, NULL);
-        fclose(fp);
-        fprintf(stderr, "png_create_info_struct failed\n");
-        exit(EXIT_FAILURE);
-    }
-
-    if (setjmp(png_jmpbuf(png_ptr))) {
-        png_destroy_write_struct(&png_ptr, &info_ptr);
-        fclose(fp);
-        fprintf(stderr, "Error during png writing\n");
-        exit(EXIT_FAILURE);
-    }
-
-    png_init_io(png_ptr, fp);
-
-    // 设置PNG图像的相关信息
-    png_set_IHDR(png_ptr, info_ptr, width, height,
-                 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
-                 PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-
-    png_write_info(png_ptr, info_ptr);
-
-    // 写入图像数据
-    for (int y = 0; y < height; y++) {
-        png_write_row(png_ptr, data + y * width * 3);
-    }
-
-    png_write_end(png_ptr, NULL);
-
-    png_destroy_write_struct(&png_ptr, &info_ptr);
-    fclose(fp);
+#include "conv_tool.h"
+#include "dec_tool.h"
+#include "png_tool.h"
+#include "seq_tool.h"
+
+// 公共导出状态加 PNG 写线程池，RGB 帧由写线程池循环提供
+typedef struct PngExporter {
+    Exporter base;
+    PngWriter *png;
+} PngExporter;
+
+static int png_exporter_free(PngExporter *ex) {
+    int ret = png_writer_close(&ex->png);
+    exporter_free(&ex->base);
+    return ret;
 }
 
-static int decode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, const char *filename) {
+static int decode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, PngExporter *ex) {
     int ret = -1;
-    char buf[1024];
+    char buf[4096];
     ret = avcodec_send_packet(ctx, pkt);
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR, "failed to send frame to decode\n");
-        goto end;
-    }
-
-    frame->format = ctx->pix_fmt;
-    frame->width = ctx->width;
-    frame->height = ctx->height;
-    uint8_t *rgb_data = av_malloc(av_image_get_buffer_size(AV_PIX_FMT_RGB24, ctx->width, ctx->height, 1));
-    if (!rgb_data) {
-        fprintf(stderr, "Could not allocate RGB data buffer\n");
-        return 1;
-    }
-
-    struct SwsContext *sws_ctx = sws_getContext(ctx->width, ctx->height, ctx->pix_fmt,
-                                                ctx->width, ctx->height, AV_PIX_FMT_RGB24,
-                                                SWS_BILINEAR, NULL, NULL, NULL);
-    if (!sws_ctx) {
-        fprintf(stderr, "Could not initialize the conversion context\n");
-        return 1;
+        return 0;
     }
 
     while (ret >= 0) {
@@ -92,25 +41,40 @@ static int decode(AVCodecContext *ctx, AVFrame *frame, AVPacket *pkt, const char
             return -1;
         }
 
-        int rgb_linesize = ctx->width * 3;
-        uint8_t *rgb_data_ptr[1] = { rgb_data }; // 对于单平面格式，如 RGB24
-        const int dstStride[1] = { rgb_linesize };
-        sws_scale(sws_ctx, (const uint8_t *const *)frame->data, frame->linesize, 0,
-                  ctx->height, rgb_data_ptr, dstStride);
+        // 输出编号按解码器交出帧的顺序计数，帧线程的延迟与重排不影响编号
+        if (seq_output_path(ex->base.seq, ex->base.frames, buf, sizeof(buf)) < 0) {
+            return -1;
+        }
+
+        // 写线程全忙时在这里等待空闲帧，在途帧数因此有上限
+        AVFrame *rgb;
+        if (png_writer_get(ex->png, &rgb) < 0) {
+            return -1;
+        }
 
-        snprintf(buf, sizeof(buf), filename, ctx->frame_num);
+        // 按解码帧自身的宽高转换，分辨率变化时缓冲区与上下文随之重建
+        ret = conv_frame_alloc(rgb, frame->width, frame->height, AV_PIX_FMT_RGB24);
+        if (ret >= 0) {
+            ret = conv_cache_convert(&ex->base.conv, frame, rgb, SWS_BILINEAR);
+        }
+        if (ret < 0) {
+            // 该帧不再回到空闲列表，由 png_writer_close 统一释放
+            return -1;
+        }
 
-        write_png(buf, rgb_data, ctx->width, ctx->height);
+        if (png_writer_submit(ex->png, rgb, buf) < 0) {
+            return -1;
+        }
 
-        if (pkt) {
-            av_packet_unref(pkt);
+        if (++ex->base.frames % 1000 == 0) {
+            exporter_log_rss(&ex->base);
         }
+        av_frame_unref(frame);
     }
-end:
     return 0;
 }
 
-// output.mp4 %03d.png
+// output.mp4 %03d.png [--start-number 1] [--shard 1000] [--decode-threads 0] [--decode-thread-type auto] [--png-threads 8] [--png-preset fast]
 int main(int argc, char **argv) {
     const char *src, *dst;
     int ret = 0;
@@ -124,6 +88,39 @@ int main(int argc, char **argv) {
     src = argv[1];
     dst = argv[2];
 
+    // 帧序列、PNG 与解码器参数 --name value
+    SeqOptions seq_opts;
+    PngOptions png_opts;
+    DecOptions dec_opts;
+    PngExporter ex = {0};
+    seq_options_init(&seq_opts);
+    png_options_init(&png_opts);
+    dec_options_init(&dec_opts);
+    for (int k = 3; k < argc; k += 2) {
+        if (k + 1 >= argc || strncmp(argv[k], "--", 2) != 0) {
+            av_log(NULL, AV_LOG_ERROR, "invalid option: %s\n", argv[k]);
+            exit(-1);
+        }
+        ret = seq_options_parse(&seq_opts, argv[k] + 2, argv[k + 1]);
+        if (ret == 0) {
+            ret = png_options_parse(&png_opts, argv[k] + 2, argv[k + 1]);
+        }
+        if (ret == 0) {
+            ret = dec_options_parse(&dec_opts, argv[k] + 2, argv[k + 1]);
+        }
+        if (ret <= 0) {
+            av_log(NULL, AV_LOG_ERROR, "invalid option: %s\n", argv[k]);
+            exit(-1);
+        }
+    }
+    if (seq_open(&ex.base.seq, dst, &seq_opts) < 0) {
+        exit(-1);
+    }
+    if (png_writer_start(&ex.png, &png_opts) < 0) {
+        png_exporter_free(&ex);
+        exit(-1);
+    }
+
     // 打开多媒体文件
     ret = avformat_open_input(&fmt_ctx, src, NULL, NULL);
     if (ret < 0) {
@@ -154,12 +151,16 @@ int main(int argc, char **argv) {
     }
     avcodec_parameters_to_context(ctx, in_stream->codecpar);
 
+    // 线程参数必须在打开解码器之前设置
+    dec_options_apply(&dec_opts, ctx);
+
     // 解码器与解码器上下文绑定到一起
     ret = avcodec_open2(ctx, codec, NULL);
     if (ret < 0) {
         av_log(ctx, AV_LOG_ERROR, "Don't open codec: %s \n", av_err2str(ret));
         goto err;
     }
+    dec_options_log(ctx);
 
     // 创建AVFrame
     AVFrame *frame = av_frame_alloc();
@@ -176,13 +177,19 @@ int main(int argc, char **argv) {
     }
 
     // 从源多媒体文件中读到的视频数据到目的文件中
+    int64_t start = av_gettime_relative();
     while (av_read_frame(fmt_ctx, pkt) >= 0) {
         if (pkt->stream_index == idx) {
-            // 调用write_png函数来保存为PNG图片
-            decode(ctx, frame, pkt, dst);
+            // 转换后的 RGB 帧交给写线程池保存为PNG图片
+            if (decode(ctx, frame, pkt, &ex) < 0) {
+                av_packet_unref(pkt);
+                break;
+            }
         }
+        av_packet_unref(pkt);
     }
-    decode(ctx, frame, NULL, dst);
+    decode(ctx, frame, NULL, &ex);
+    dec_log_throughput(ctx, ex.base.frames, start);
 
     err:
     if (fmt_ctx) {
@@ -201,5 +208,8 @@ int main(int argc, char **argv) {
         av_packet_free(&pkt);
         pkt = NULL;
     }
-    return 0;
+    // 等写线程把剩余的帧写完后再统计内存
+    ret = png_exporter_free(&ex);
+    exporter_log_rss(&ex.base);
+    return ret < 0 ? -1 : 0;
 }
\ No newline at end of file
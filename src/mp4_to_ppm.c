@@ -3,53 +3,115 @@
 #include <libavformat/avformat.h>
 #include <libswscale/swscale.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/time.h>
+#include <string.h>
 
-// 保存帧为PPM文件
-void save_frame(AVFrame *frame, int width, int height, char *filename) {
-    FILE *f;
-    int y;
+#include "dec_tool.h"
+#include "out_tool.h"
+#include "seq_tool.h"
 
-    f = fopen(filename, "wb");
-    if (f == NULL) {
-        return;
+// 保存帧为PPM文件，交给输出队列写出
+int save_frame(OutWriter *out, AVFrame *frame, int width, int height, char *filename) {
+    OutFile *file;
+    int y, ret;
+
+    ret = out_writer_get(out, (size_t) width * 3 * height, &file);
+    if (ret < 0) {
+        return ret;
     }
 
     // 写入PPM文件头
-    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    file->header_size = snprintf((char *) file->header, sizeof(file->header), "P6\n%d %d\n255\n", width, height);
 
-    // 逐行写入像素数据
+    // 逐行拷贝像素数据，去掉行尾对齐
     for (y = 0; y < height; y++) {
-        fwrite(frame->data[0] + y * frame->linesize[0], 1, width * 3, f);
+        memcpy(file->data + (size_t) y * width * 3, frame->data[0] + y * frame->linesize[0], width * 3);
     }
+    file->size = (size_t) width * 3 * height;
 
-    fclose(f);
+    return out_writer_submit(out, file, filename);
+}
+
+// 收完解码器当前能交出的所有帧，帧线程下前几个包不会立刻出帧，编号按交出顺序递增
+static int save_frames(AVCodecContext *ctx, AVFrame *src_frame, AVFrame *dst_frame,
+                       struct SwsContext *sws_ctx, FrameSeq *seq, OutWriter *out, int *i) {
+    char filename[4096];
+    int ret;
+    while ((ret = avcodec_receive_frame(ctx, src_frame)) >= 0) {
+        // 转换格式并保存帧
+        sws_scale(sws_ctx, (uint8_t const * const *)src_frame->data,
+                  src_frame->linesize, 0, ctx->height,
+                  dst_frame->data, dst_frame->linesize);
+        if (seq_output_path(seq, *i, filename, sizeof(filename)) < 0) {
+            return -1;
+        }
+        if (save_frame(out, dst_frame, ctx->width, ctx->height, filename) < 0) {
+            return -1;
+        }
+        (*i)++;
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
 }
 
-// output.mp4 %03d.ppm
+// output.mp4 %03d.ppm [--start-number 1] [--shard 1000] [--decode-threads 0] [--decode-thread-type auto]
+//                      [--out-backend auto|uring|threads] [--out-depth 64] [--out-batch 16] [--out-threads 4] [--out-fsync none]
 int main(int argc, char *argv[]) {
 
     char *src, *dst;
     AVFormatContext *fmt_ctx = NULL;
-    int i, stream, num_bytes, ret;
+    int i, stream, num_bytes, ret = 0;
     AVCodecContext *ctx = NULL;
     AVCodec *codec = NULL;
-    AVFrame *src_frame, *dst_frame;
-    AVPacket *pkt;
+    AVFrame *src_frame = NULL, *dst_frame = NULL;
+    AVPacket *pkt = NULL;
     uint8_t *buffer = NULL;
     struct SwsContext *sws_ctx = NULL;
-    char filename[20];
+    SeqOptions seq_opts;
+    DecOptions dec_opts;
+    OutOptions out_opts;
+    FrameSeq *seq = NULL;
+    OutWriter *out = NULL;
+    int64_t dec_log_start;
 
     av_log_set_level(AV_LOG_DEBUG);
 
     // 输入参数
     if (argc < 3) {
         av_log(NULL, AV_LOG_ERROR, "arguments must be more than 2\n");
+        ret = AVERROR(EINVAL);
         goto err;
     }
 
     src = argv[1];
     dst = argv[2];
 
+    // 帧序列、解码器与输出参数 --name value
+    seq_options_init(&seq_opts);
+    dec_options_init(&dec_opts);
+    out_options_init(&out_opts);
+    for (int k = 3; k < argc; k += 2) {
+        if (k + 1 >= argc || strncmp(argv[k], "--", 2) != 0) {
+            av_log(NULL, AV_LOG_ERROR, "invalid option: %s\n", argv[k]);
+            ret = AVERROR(EINVAL);
+            goto err;
+        }
+        ret = seq_options_parse(&seq_opts, argv[k] + 2, argv[k + 1]);
+        if (ret == 0) {
+            ret = dec_options_parse(&dec_opts, argv[k] + 2, argv[k + 1]);
+        }
+        if (ret == 0) {
+            ret = out_options_parse(&out_opts, argv[k] + 2, argv[k + 1]);
+        }
+        if (ret <= 0) {
+            av_log(NULL, AV_LOG_ERROR, "invalid option: %s\n", argv[k]);
+            ret = ret < 0 ? ret : AVERROR(EINVAL);
+            goto err;
+        }
+    }
+    if ((ret = seq_open(&seq, dst, &seq_opts)) < 0 || (ret = out_writer_open(&out, &out_opts)) < 0) {
+        goto err;
+    }
+
     // 打开视频文件
     ret = avformat_open_input(&fmt_ctx, src, NULL, NULL);
     if (ret < 0) {
@@ -74,6 +136,7 @@ int main(int argc, char *argv[]) {
     }
     if (stream == -1) {
         av_log(NULL, AV_LOG_ERROR, "Could not find video stream\n");
+        ret = AVERROR_STREAM_NOT_FOUND;
         goto err;
     }
 
@@ -85,15 +148,20 @@ int main(int argc, char *argv[]) {
     codec = avcodec_find_decoder(ctx->codec_id);
     if (codec == NULL) {
         av_log(NULL, AV_LOG_ERROR, "don't find Codec\n");
-        goto err;;
+        ret = AVERROR_DECODER_NOT_FOUND;
+        goto err;
     }
 
+    // 线程参数必须在打开解码器之前设置
+    dec_options_apply(&dec_opts, ctx);
+
     // 打开解码器
     ret = avcodec_open2(ctx, codec, NULL);
     if (ret < 0) {
         av_log(ctx, AV_LOG_ERROR, "Don't open codec: %s \n", av_err2str(ret));
         goto err;
     }
+    dec_options_log(ctx);
 
     // 分配视频帧内存
     src_frame = av_frame_alloc();
@@ -113,26 +181,28 @@ int main(int argc, char *argv[]) {
     pkt = av_packet_alloc();
     if (!pkt) {
         av_log(NULL, AV_LOG_ERROR, "NO MEMORY!\n");
+        ret = AVERROR(ENOMEM);
         goto err;
     }
 
+    dec_log_start = av_gettime_relative();
     i = 0;
     // 读取视频帧
     while (av_read_frame(fmt_ctx, pkt) >= 0) {
         if (pkt->stream_index == stream) {
             // 解码视频帧
-            avcodec_send_packet(ctx, pkt);
-            avcodec_receive_frame(ctx, src_frame);
-
-            // 转换格式并保存帧
-            sws_scale(sws_ctx, (uint8_t const * const *)src_frame->data,
-                      src_frame->linesize, 0, ctx->height,
-                      dst_frame->data, dst_frame->linesize);
-            sprintf(filename, dst, i + 1);
-            save_frame(dst_frame, ctx->width, ctx->height, filename);
-            i++;
+            ret = avcodec_send_packet(ctx, pkt);
+            if (ret >= 0 && (ret = save_frames(ctx, src_frame, dst_frame, sws_ctx, seq, out, &i)) < 0) {
+                av_packet_unref(pkt);
+                goto err;
+            }
         }
+        av_packet_unref(pkt);
     }
+    // 取出解码器中延迟的帧
+    avcodec_send_packet(ctx, NULL);
+    ret = save_frames(ctx, src_frame, dst_frame, sws_ctx, seq, out, &i);
+    dec_log_throughput(ctx, i, dec_log_start);
 
 err:
     if (buffer) {
@@ -153,5 +223,11 @@ err:
     if (fmt_ctx) {
         avformat_close_input(&fmt_ctx);
     }
-    return 0;
+    // 还在队列里的文件写失败同样算导出失败
+    int out_ret = out_writer_close(&out);
+    if (out_ret < 0 && ret >= 0) {
+        ret = out_ret;
+    }
+    seq_free(&seq);
+    return ret < 0 ? -1 : 0;
 }
\ No newline at end of file
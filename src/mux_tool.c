@@ -0,0 +1,351 @@
+#include "mux_tool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libavformat/avformat.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+
+// 待写入的数据块，offset 为文件内的绝对位置
+typedef struct MuxBlock {
+    struct MuxBlock *next;
+    int64_t offset;
+    int size;
+    uint8_t data[];
+} MuxBlock;
+
+struct Muxer {
+    AVFormatContext *oc;
+    AVStream *st;
+    AVRational enc_time_base;
+    MuxOptions opts;
+    char *filename;
+    int fd;
+
+    // 编码线程一侧的逻辑写位置与文件大小
+    int64_t pos;
+    int64_t size;
+
+    // 写线程队列
+    pthread_t thread;
+    int thread_started;
+    int header_written;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t space;
+    MuxBlock *head, *tail;
+    size_t queued_bytes;
+    int queued_blocks;
+    int writing;
+    int eof;
+    int error;
+
+    // 统计
+    int64_t bytes_written;
+    int64_t packets;
+    int max_queued_blocks;
+    size_t max_queued_bytes;
+    int64_t blocked_us;
+};
+
+void mux_options_init(MuxOptions *opts) {
+    opts->faststart = 0;
+    opts->buffer_size = 1 << 20;
+    opts->queue_bytes = (size_t) 64 << 20;
+}
+
+int mux_options_parse(MuxOptions *opts, const char *name, const char *value) {
+    if (strcmp(name, "faststart") == 0) {
+        opts->faststart = atoi(value) != 0;
+    } else if (strcmp(name, "mux-buffer-kb") == 0) {
+        opts->buffer_size = atoi(value) << 10;
+        if (opts->buffer_size <= 0) {
+            return AVERROR(EINVAL);
+        }
+    } else if (strcmp(name, "mux-queue-mb") == 0) {
+        opts->queue_bytes = (size_t) strtoul(value, NULL, 10) << 20;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static void *mux_writer(void *arg) {
+    Muxer *mux = arg;
+    pthread_mutex_lock(&mux->lock);
+    for (;;) {
+        while (!mux->head && !mux->eof) {
+            pthread_cond_wait(&mux->not_empty, &mux->lock);
+        }
+        MuxBlock *block = mux->head;
+        if (!block) {
+            break;
+        }
+        mux->head = block->next;
+        if (!mux->head) {
+            mux->tail = NULL;
+        }
+        mux->writing = 1;
+        pthread_mutex_unlock(&mux->lock);
+
+        int err = 0;
+        int done = 0;
+        while (done < block->size) {
+            ssize_t n = pwrite(mux->fd, block->data + done, block->size - done, block->offset + done);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                err = AVERROR(errno);
+                break;
+            }
+            done += n;
+        }
+
+        pthread_mutex_lock(&mux->lock);
+        mux->writing = 0;
+        mux->queued_bytes -= block->size;
+        mux->queued_blocks--;
+        mux->bytes_written += done;
+        if (err && !mux->error) {
+            mux->error = err;
+        }
+        pthread_cond_broadcast(&mux->space);
+        free(block);
+    }
+    pthread_mutex_unlock(&mux->lock);
+    return NULL;
+}
+
+// 等待队列中的数据全部落盘
+static int mux_drain(Muxer *mux) {
+    pthread_mutex_lock(&mux->lock);
+    while ((mux->head || mux->writing) && !mux->error) {
+        pthread_cond_wait(&mux->space, &mux->lock);
+    }
+    int err = mux->error;
+    pthread_mutex_unlock(&mux->lock);
+    return err;
+}
+
+#if LIBAVFORMAT_VERSION_MAJOR < 61
+static int mux_write_cb(void *opaque, uint8_t *buf, int size)
+#else
+static int mux_write_cb(void *opaque, const uint8_t *buf, int size)
+#endif
+{
+    Muxer *mux = opaque;
+    MuxBlock *block = malloc(sizeof(MuxBlock) + size);
+    if (!block) {
+        return AVERROR(ENOMEM);
+    }
+    block->next = NULL;
+    block->offset = mux->pos;
+    block->size = size;
+    memcpy(block->data, buf, size);
+
+    pthread_mutex_lock(&mux->lock);
+    // 队列满时编码线程阻塞，计入统计
+    if (mux->queued_blocks > 0 && mux->queued_bytes + size > mux->opts.queue_bytes && !mux->error) {
+        int64_t start = av_gettime_relative();
+        while (mux->queued_blocks > 0 && mux->queued_bytes + size > mux->opts.queue_bytes && !mux->error) {
+            pthread_cond_wait(&mux->space, &mux->lock);
+        }
+        mux->blocked_us += av_gettime_relative() - start;
+    }
+    if (mux->error) {
+        int err = mux->error;
+        pthread_mutex_unlock(&mux->lock);
+        free(block);
+        return err;
+    }
+    if (mux->tail) {
+        mux->tail->next = block;
+    } else {
+        mux->head = block;
+    }
+    mux->tail = block;
+    mux->queued_bytes += size;
+    mux->queued_blocks++;
+    mux->max_queued_blocks = FFMAX(mux->max_queued_blocks, mux->queued_blocks);
+    mux->max_queued_bytes = FFMAX(mux->max_queued_bytes, mux->queued_bytes);
+    pthread_cond_signal(&mux->not_empty);
+    pthread_mutex_unlock(&mux->lock);
+
+    mux->pos += size;
+    mux->size = FFMAX(mux->size, mux->pos);
+    return size;
+}
+
+static int64_t mux_seek_cb(void *opaque, int64_t offset, int whence) {
+    Muxer *mux = opaque;
+    if (whence & AVSEEK_SIZE) {
+        return mux->size;
+    }
+    // 回写文件头前先落盘，保证随后按文件名重新读取（如 faststart）时数据完整
+    int err = mux_drain(mux);
+    if (err) {
+        return err;
+    }
+    switch (whence & ~AVSEEK_FORCE) {
+        case SEEK_SET:
+            mux->pos = offset;
+            break;
+        case SEEK_CUR:
+            mux->pos += offset;
+            break;
+        case SEEK_END:
+            mux->pos = mux->size + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    return mux->pos;
+}
+
+int mux_alloc(Muxer **pmux, const char *filename, const MuxOptions *opts) {
+    Muxer *mux = av_mallocz(sizeof(Muxer));
+    if (!mux) {
+        return AVERROR(ENOMEM);
+    }
+    mux->opts = *opts;
+    mux->fd = -1;
+    pthread_mutex_init(&mux->lock, NULL);
+    pthread_cond_init(&mux->not_empty, NULL);
+    pthread_cond_init(&mux->space, NULL);
+    *pmux = mux;
+
+    mux->filename = av_strdup(filename);
+    int ret = avformat_alloc_output_context2(&mux->oc, NULL, NULL, filename);
+    if (ret < 0 || !mux->filename) {
+        av_log(NULL, AV_LOG_ERROR, "Could not deduce output format from file extension: %s\n", filename);
+        return ret < 0 ? ret : AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+int mux_need_global_header(const Muxer *mux) {
+    return (mux->oc->oformat->flags & AVFMT_GLOBALHEADER) != 0;
+}
+
+int mux_start(Muxer *mux, const AVCodecContext *enc) {
+    AVDictionary *opts = NULL;
+    int ret;
+
+    mux->st = avformat_new_stream(mux->oc, NULL);
+    if (!mux->st) {
+        return AVERROR(ENOMEM);
+    }
+    ret = avcodec_parameters_from_context(mux->st->codecpar, enc);
+    if (ret < 0) {
+        return ret;
+    }
+    mux->st->time_base = enc->time_base;
+    mux->st->avg_frame_rate = enc->framerate;
+    mux->enc_time_base = enc->time_base;
+
+    // 输出经由写线程落盘，AVIO 只负责攒大块
+    mux->fd = open(mux->filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (mux->fd < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Don't open file: %s\n", mux->filename);
+        return AVERROR(errno);
+    }
+    uint8_t *buffer = av_malloc(mux->opts.buffer_size);
+    if (!buffer) {
+        return AVERROR(ENOMEM);
+    }
+    mux->oc->pb = avio_alloc_context(buffer, mux->opts.buffer_size, 1, mux, NULL, mux_write_cb, mux_seek_cb);
+    if (!mux->oc->pb) {
+        av_free(buffer);
+        return AVERROR(ENOMEM);
+    }
+    mux->oc->pb->seekable = AVIO_SEEKABLE_NORMAL;
+    mux->oc->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    ret = pthread_create(&mux->thread, NULL, mux_writer, mux);
+    if (ret) {
+        return AVERROR(ret);
+    }
+    mux->thread_started = 1;
+
+    if (mux->opts.faststart) {
+        av_dict_set(&opts, "movflags", "+faststart", 0);
+    }
+    ret = avformat_write_header(mux->oc, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Could not write header: %s\n", av_err2str(ret));
+        return ret;
+    }
+    mux->header_written = 1;
+    return 0;
+}
+
+int mux_write(Muxer *mux, AVPacket *pkt) {
+    av_packet_rescale_ts(pkt, mux->enc_time_base, mux->st->time_base);
+    pkt->stream_index = mux->st->index;
+    mux->packets++;
+    int ret = av_interleaved_write_frame(mux->oc, pkt);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Could not write packet: %s\n", av_err2str(ret));
+    }
+    return ret;
+}
+
+int mux_close(Muxer **pmux) {
+    Muxer *mux = *pmux;
+    int ret = 0;
+    if (!mux) {
+        return 0;
+    }
+    if (mux->header_written) {
+        ret = av_write_trailer(mux->oc);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Could not write trailer: %s\n", av_err2str(ret));
+        }
+    }
+    if (mux->thread_started) {
+        pthread_mutex_lock(&mux->lock);
+        mux->eof = 1;
+        pthread_cond_signal(&mux->not_empty);
+        pthread_mutex_unlock(&mux->lock);
+        pthread_join(mux->thread, NULL);
+        if (mux->error && ret >= 0) {
+            ret = mux->error;
+            av_log(NULL, AV_LOG_ERROR, "Could not write file %s: %s\n", mux->filename, av_err2str(ret));
+        }
+        av_log(NULL, AV_LOG_INFO,
+               "muxer: %"PRId64" packets, %"PRId64" bytes written, max queue %d blocks (%zu bytes), "
+               "encoder blocked %.3f s\n",
+               mux->packets, mux->bytes_written, mux->max_queued_blocks, mux->max_queued_bytes,
+               mux->blocked_us / 1000000.0);
+    }
+    if (mux->oc) {
+        if (mux->oc->pb) {
+            av_freep(&mux->oc->pb->buffer);
+            avio_context_free(&mux->oc->pb);
+        }
+        avformat_free_context(mux->oc);
+    }
+    if (mux->fd >= 0) {
+        close(mux->fd);
+    }
+    // 未完成时写线程可能已有数据滞留
+    while (mux->head) {
+        MuxBlock *next = mux->head->next;
+        free(mux->head);
+        mux->head = next;
+    }
+    pthread_mutex_destroy(&mux->lock);
+    pthread_cond_destroy(&mux->not_empty);
+    pthread_cond_destroy(&mux->space);
+    av_freep(&mux->filename);
+    av_freep(pmux);
+    return ret;
+}
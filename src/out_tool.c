@@ -0,0 +1,529 @@
+#include "out_tool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include <libavutil/avstring.h>
+#include <libavutil/common.h>
+#include <libavutil/error.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+
+enum {
+    OP_OPEN,
+    OP_WRITE,
+    OP_FSYNC,
+    OP_CLOSE,
+};
+
+struct OutWriter {
+    OutOptions opts;
+    int backend;
+    OutFile *files;
+    int depth;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t space;
+    int *free_slots;
+    int nb_free;
+    int *queue;             // 线程池后端待写入的槽位
+    int head;
+    int count;
+    pthread_t *threads;
+    int nb_started;
+    int eof;
+    int error;
+
+#ifdef HAVE_LIBURING
+    struct io_uring ring;
+    int ring_ready;
+    int unsubmitted;        // 已放入提交队列但还没提交的文件数
+    int inflight;
+#endif
+
+    // 统计
+    int64_t written;
+    int64_t failed;
+    int64_t bytes;
+    int64_t batches;
+    int64_t get_stalls;
+    int64_t get_wait_us;
+};
+
+void out_options_init(OutOptions *opts) {
+    opts->backend = OUT_BACKEND_AUTO;
+    opts->depth = 64;
+    opts->batch = 16;
+    opts->threads = 4;
+    opts->fsync = OUT_FSYNC_NONE;
+}
+
+int out_options_parse(OutOptions *opts, const char *name, const char *value) {
+    if (strcmp(name, "out-backend") == 0) {
+        if (strcmp(value, "auto") == 0) {
+            opts->backend = OUT_BACKEND_AUTO;
+        } else if (strcmp(value, "uring") == 0) {
+            opts->backend = OUT_BACKEND_URING;
+        } else if (strcmp(value, "threads") == 0) {
+            opts->backend = OUT_BACKEND_THREADS;
+        } else {
+            av_log(NULL, AV_LOG_ERROR, "out-backend must be auto, uring or threads\n");
+            return AVERROR(EINVAL);
+        }
+    } else if (strcmp(name, "out-fsync") == 0) {
+        if (strcmp(value, "none") == 0) {
+            opts->fsync = OUT_FSYNC_NONE;
+        } else if (strcmp(value, "data") == 0) {
+            opts->fsync = OUT_FSYNC_DATA;
+        } else if (strcmp(value, "file") == 0) {
+            opts->fsync = OUT_FSYNC_FILE;
+        } else {
+            av_log(NULL, AV_LOG_ERROR, "out-fsync must be none, data or file\n");
+            return AVERROR(EINVAL);
+        }
+    } else if (strcmp(name, "out-depth") == 0) {
+        opts->depth = atoi(value);
+        if (opts->depth < 1) {
+            return AVERROR(EINVAL);
+        }
+    } else if (strcmp(name, "out-batch") == 0) {
+        opts->batch = atoi(value);
+        if (opts->batch < 1) {
+            return AVERROR(EINVAL);
+        }
+    } else if (strcmp(name, "out-threads") == 0) {
+        opts->threads = atoi(value);
+        if (opts->threads < 0) {
+            return AVERROR(EINVAL);
+        }
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static void set_error(OutWriter *w, int err, OutFile *f) {
+    f->failed = 1;
+    if (!w->error) {
+        av_log(NULL, AV_LOG_ERROR, "Could not write %s: %s\n", f->path, av_err2str(err));
+        w->error = err;
+    }
+}
+
+// 线程池与直接写入用的同步路径
+static int write_file(const OutFile *f, int fsync_mode) {
+    int fd = open(f->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return AVERROR(errno);
+    }
+    struct iovec iov[2] = {f->iov[0], f->iov[1]};
+    struct iovec *p = iov;
+    int n = 2;
+    int ret = 0;
+    while (n > 0) {
+        ssize_t done = writev(fd, p, n);
+        if (done < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ret = AVERROR(errno);
+            break;
+        }
+        // 短写时跳过已写完的部分继续
+        while (n > 0 && (size_t) done >= p->iov_len) {
+            done -= p->iov_len;
+            p++;
+            n--;
+        }
+        if (n > 0) {
+            p->iov_base = (uint8_t *) p->iov_base + done;
+            p->iov_len -= done;
+        }
+    }
+    if (!ret && fsync_mode == OUT_FSYNC_DATA && fdatasync(fd) < 0) {
+        ret = AVERROR(errno);
+    } else if (!ret && fsync_mode == OUT_FSYNC_FILE && fsync(fd) < 0) {
+        ret = AVERROR(errno);
+    }
+    if (close(fd) < 0 && !ret) {
+        ret = AVERROR(errno);
+    }
+    return ret;
+}
+
+// 调用时持有锁
+static void file_done(OutWriter *w, OutFile *f) {
+    if (f->failed) {
+        w->failed++;
+    } else {
+        w->written++;
+        w->bytes += f->header_size + f->size;
+    }
+    f->failed = 0;
+    w->free_slots[w->nb_free++] = f->slot;
+    pthread_cond_signal(&w->space);
+}
+
+static void *out_worker(void *arg) {
+    OutWriter *w = arg;
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->count && !w->eof) {
+            pthread_cond_wait(&w->work, &w->lock);
+        }
+        if (!w->count) {
+            break;
+        }
+        OutFile *f = &w->files[w->queue[w->head]];
+        w->head = (w->head + 1) % w->depth;
+        w->count--;
+        pthread_mutex_unlock(&w->lock);
+
+        int ret = write_file(f, w->opts.fsync);
+
+        pthread_mutex_lock(&w->lock);
+        if (ret < 0) {
+            set_error(w, ret, f);
+        }
+        file_done(w, f);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+#ifdef HAVE_LIBURING
+static int uring_init(OutWriter *w) {
+    // 每个文件最多 打开、写入、同步、关闭 四个操作
+    int ret = io_uring_queue_init(w->depth * 4, &w->ring, 0);
+    if (ret < 0) {
+        return ret;
+    }
+    w->ring_ready = 1;
+
+    // 以直接方式打开到固定文件表（openat direct）与 mkdirat 同在 5.15 加入，借它判断内核是否支持
+    struct io_uring_probe *probe = io_uring_get_probe_ring(&w->ring);
+    int supported = probe && io_uring_opcode_supported(probe, IORING_OP_MKDIRAT)
+                    && io_uring_opcode_supported(probe, IORING_OP_CLOSE);
+    io_uring_free_probe(probe);
+    if (!supported) {
+        return AVERROR(ENOSYS);
+    }
+
+    int *fds = av_malloc_array(w->depth, sizeof(*fds));
+    if (!fds) {
+        return AVERROR(ENOMEM);
+    }
+    for (int k = 0; k < w->depth; k++) {
+        fds[k] = -1;
+    }
+    ret = io_uring_register_files(&w->ring, fds, w->depth);
+    av_free(fds);
+    return ret;
+}
+
+// 提交队列按 depth 个文件、每个四个操作分配，在途文件不超过 depth，不会取不到。
+// 补发的关闭只出现在原链已提交之后，同样算在这个文件的名额里
+static struct io_uring_sqe *uring_sqe(OutWriter *w) {
+    return io_uring_get_sqe(&w->ring);
+}
+
+// 一个文件对应一条链：打开到槽位号对应的固定文件，整体写入，可选同步，关闭。
+// 链中某一步失败时后续步骤以 -ECANCELED 完成，每一步都有完成事件
+static void uring_queue(OutWriter *w, OutFile *f) {
+    struct io_uring_sqe *sqe = uring_sqe(w);
+    io_uring_prep_openat_direct(sqe, AT_FDCWD, f->path, O_WRONLY | O_CREAT | O_TRUNC, 0644, f->slot);
+    io_uring_sqe_set_data64(sqe, (uint64_t) f->slot << 2 | OP_OPEN);
+    sqe->flags |= IOSQE_IO_LINK;
+    f->pending = 1;
+    f->opened = 0;
+
+    sqe = uring_sqe(w);
+    io_uring_prep_writev(sqe, f->slot, f->iov, 2, 0);
+    io_uring_sqe_set_data64(sqe, (uint64_t) f->slot << 2 | OP_WRITE);
+    sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+    f->pending++;
+
+    if (w->opts.fsync != OUT_FSYNC_NONE) {
+        sqe = uring_sqe(w);
+        io_uring_prep_fsync(sqe, f->slot, w->opts.fsync == OUT_FSYNC_DATA ? IORING_FSYNC_DATASYNC : 0);
+        io_uring_sqe_set_data64(sqe, (uint64_t) f->slot << 2 | OP_FSYNC);
+        sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+        f->pending++;
+    }
+
+    sqe = uring_sqe(w);
+    io_uring_prep_close_direct(sqe, f->slot);
+    io_uring_sqe_set_data64(sqe, (uint64_t) f->slot << 2 | OP_CLOSE);
+    f->pending++;
+
+    w->unsubmitted++;
+    w->inflight++;
+}
+
+static void uring_complete(OutWriter *w, const struct io_uring_cqe *cqe) {
+    uint64_t data = io_uring_cqe_get_data64(cqe);
+    OutFile *f = &w->files[data >> 2];
+    int op = data & 3;
+    if (cqe->res < 0 && cqe->res != -ECANCELED) {
+        set_error(w, AVERROR(-cqe->res), f);
+    } else if (op == OP_WRITE && cqe->res >= 0 && (size_t) cqe->res != f->header_size + f->size) {
+        // 普通文件上的 writev 不会短写，出现时按错误处理
+        set_error(w, AVERROR(EIO), f);
+    }
+    if (op == OP_OPEN && cqe->res >= 0) {
+        f->opened = 1;
+    } else if (op == OP_CLOSE && cqe->res >= 0) {
+        f->opened = 0;
+    } else if (op == OP_CLOSE && f->opened) {
+        // 写入或同步失败（含短写）时链上的关闭被取消，固定文件仍占着槽位，
+        // 单独补发一次关闭，槽位等它完成后才回到空闲列表
+        struct io_uring_sqe *sqe = uring_sqe(w);
+        io_uring_prep_close_direct(sqe, f->slot);
+        io_uring_sqe_set_data64(sqe, (uint64_t) f->slot << 2 | OP_CLOSE);
+        f->pending++;
+        w->unsubmitted++;
+    }
+    if (--f->pending == 0) {
+        w->inflight--;
+        file_done(w, f);
+    }
+}
+
+// 提交所有未提交的文件并处理已完成的事件，wait 时至少等到一个完成事件
+static int uring_reap(OutWriter *w, int wait) {
+    struct io_uring_cqe *cqe;
+    int ret;
+    if (w->unsubmitted) {
+        ret = wait ? io_uring_submit_and_wait(&w->ring, 1) : io_uring_submit(&w->ring);
+        w->batches++;
+        w->unsubmitted = 0;
+        if (ret < 0) {
+            return ret;
+        }
+        ret = io_uring_peek_cqe(&w->ring, &cqe);
+    } else {
+        ret = wait ? io_uring_wait_cqe(&w->ring, &cqe) : io_uring_peek_cqe(&w->ring, &cqe);
+    }
+    while (ret == 0) {
+        uring_complete(w, cqe);
+        io_uring_cqe_seen(&w->ring, cqe);
+        ret = io_uring_peek_cqe(&w->ring, &cqe);
+    }
+    return ret == -EAGAIN || ret == -EINTR ? 0 : ret;
+}
+#endif
+
+int out_writer_open(OutWriter **pw, const OutOptions *opts) {
+    OutWriter *w = av_mallocz(sizeof(*w));
+    if (!w) {
+        return AVERROR(ENOMEM);
+    }
+    w->opts = *opts;
+    w->depth = FFMAX(opts->depth, 1);
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->work, NULL);
+    pthread_cond_init(&w->space, NULL);
+    w->files = av_calloc(w->depth, sizeof(*w->files));
+    w->free_slots = av_calloc(w->depth, sizeof(*w->free_slots));
+    w->queue = av_calloc(w->depth, sizeof(*w->queue));
+    w->threads = av_calloc(FFMAX(opts->threads, 1), sizeof(*w->threads));
+    if (!w->files || !w->free_slots || !w->queue || !w->threads) {
+        out_writer_close(&w);
+        return AVERROR(ENOMEM);
+    }
+    for (int k = 0; k < w->depth; k++) {
+        w->files[k].slot = k;
+        w->free_slots[w->nb_free++] = w->depth - 1 - k;
+    }
+
+    int ret;
+    w->backend = OUT_BACKEND_THREADS;
+#ifdef HAVE_LIBURING
+    if (opts->backend != OUT_BACKEND_THREADS) {
+        ret = uring_init(w);
+        if (ret >= 0) {
+            w->backend = OUT_BACKEND_URING;
+        } else {
+            if (w->ring_ready) {
+                io_uring_queue_exit(&w->ring);
+                w->ring_ready = 0;
+            }
+            if (opts->backend == OUT_BACKEND_URING) {
+                av_log(NULL, AV_LOG_ERROR, "io_uring is not available: %s\n", av_err2str(ret));
+                out_writer_close(&w);
+                return ret;
+            }
+            av_log(NULL, AV_LOG_INFO, "io_uring is not available, writing files on %d threads\n", opts->threads);
+        }
+    }
+#else
+    if (opts->backend == OUT_BACKEND_URING) {
+        av_log(NULL, AV_LOG_ERROR, "built without io_uring support\n");
+        out_writer_close(&w);
+        return AVERROR(ENOSYS);
+    }
+#endif
+
+    if (w->backend == OUT_BACKEND_THREADS) {
+        for (int k = 0; k < opts->threads; k++) {
+            ret = pthread_create(&w->threads[k], NULL, out_worker, w);
+            if (ret != 0) {
+                out_writer_close(&w);
+                return AVERROR(ret);
+            }
+            w->nb_started++;
+        }
+    }
+    *pw = w;
+    return 0;
+}
+
+int out_writer_get(OutWriter *w, size_t size, OutFile **file) {
+    int ret = 0;
+    pthread_mutex_lock(&w->lock);
+    if (!w->nb_free && !w->error) {
+        int64_t start = av_gettime_relative();
+#ifdef HAVE_LIBURING
+        if (w->backend == OUT_BACKEND_URING) {
+            // io_uring 在调用线程中收割完成事件，不需要等条件变量
+            while (!w->nb_free && !w->error && ret >= 0) {
+                ret = uring_reap(w, 1);
+            }
+        }
+#endif
+        while (!w->nb_free && !w->error && ret >= 0) {
+            pthread_cond_wait(&w->space, &w->lock);
+        }
+        w->get_stalls++;
+        w->get_wait_us += av_gettime_relative() - start;
+    }
+    if (ret >= 0) {
+        ret = w->error;
+    }
+    OutFile *f = NULL;
+    if (!ret) {
+        f = &w->files[w->free_slots[--w->nb_free]];
+    }
+    pthread_mutex_unlock(&w->lock);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (size > f->capacity) {
+        av_freep(&f->data);
+        f->data = av_malloc(size);
+        if (!f->data) {
+            f->capacity = 0;
+            pthread_mutex_lock(&w->lock);
+            w->free_slots[w->nb_free++] = f->slot;
+            pthread_mutex_unlock(&w->lock);
+            return AVERROR(ENOMEM);
+        }
+        f->capacity = size;
+    }
+    f->header_size = 0;
+    f->size = size;
+    *file = f;
+    return 0;
+}
+
+int out_writer_submit(OutWriter *w, OutFile *f, const char *path) {
+    av_strlcpy(f->path, path, sizeof(f->path));
+    f->iov[0].iov_base = f->header;
+    f->iov[0].iov_len = f->header_size;
+    f->iov[1].iov_base = f->data;
+    f->iov[1].iov_len = f->size;
+
+    int ret = 0;
+    pthread_mutex_lock(&w->lock);
+#ifdef HAVE_LIBURING
+    if (w->backend == OUT_BACKEND_URING) {
+        uring_queue(w, f);
+        // 攒够一批再提交，顺便收割已完成的文件
+        if (w->unsubmitted >= w->opts.batch) {
+            ret = uring_reap(w, 0);
+        }
+        if (ret >= 0) {
+            ret = w->error;
+        }
+        pthread_mutex_unlock(&w->lock);
+        return ret;
+    }
+#endif
+    if (!w->nb_started) {
+        pthread_mutex_unlock(&w->lock);
+        ret = write_file(f, w->opts.fsync);
+        pthread_mutex_lock(&w->lock);
+        if (ret < 0) {
+            set_error(w, ret, f);
+        }
+        file_done(w, f);
+    } else {
+        w->queue[(w->head + w->count) % w->depth] = f->slot;
+        w->count++;
+        pthread_cond_signal(&w->work);
+    }
+    ret = w->error;
+    pthread_mutex_unlock(&w->lock);
+    return ret;
+}
+
+int out_writer_close(OutWriter **pw) {
+    OutWriter *w = *pw;
+    if (!w) {
+        return 0;
+    }
+    int ret = 0;
+    pthread_mutex_lock(&w->lock);
+#ifdef HAVE_LIBURING
+    // 提交剩余的文件并等它们全部完成
+    while (w->ring_ready && w->inflight > 0 && ret >= 0) {
+        ret = uring_reap(w, 1);
+    }
+#endif
+    w->eof = 1;
+    pthread_cond_broadcast(&w->work);
+    pthread_mutex_unlock(&w->lock);
+    for (int k = 0; k < w->nb_started; k++) {
+        pthread_join(w->threads[k], NULL);
+    }
+#ifdef HAVE_LIBURING
+    if (w->ring_ready) {
+        io_uring_queue_exit(&w->ring);
+    }
+#endif
+    if (w->written || w->failed) {
+        av_log(NULL, w->failed ? AV_LOG_ERROR : AV_LOG_INFO,
+               "out writer (%s): %"PRId64" files written, %"PRId64" failed, %.1f MB, %"PRId64" batches, depth %d, "
+               "stalled %"PRId64" times (%.3f s)\n",
+               w->backend == OUT_BACKEND_URING ? "io_uring" : "threads", w->written, w->failed,
+               w->bytes / 1048576.0, w->batches, w->depth, w->get_stalls, w->get_wait_us / 1000000.0);
+    }
+    if (w->error) {
+        ret = w->error;
+    }
+    if (w->files) {
+        for (int k = 0; k < w->depth; k++) {
+            av_free(w->files[k].data);
+        }
+    }
+    av_free(w->files);
+    av_free(w->free_slots);
+    av_free(w->queue);
+    av_free(w->threads);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->work);
+    pthread_cond_destroy(&w->space);
+    av_freep(pw);
+    return ret;
+}
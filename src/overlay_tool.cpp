@@ -0,0 +1,118 @@
+#include "overlay_tool.h"
+
+#include <Magick++.h>
+#include <cmath>
+#include <cstring>
+
+#include "gm_tool.h"
+#include "blend_tool.h"
+
+extern "C" {
+#include <libswscale/swscale.h>
+}
+
+OverlayCache::OverlayCache(const Magick::Image &overlay, double precision, size_t max_entries, size_t max_bytes,
+                           bool yuv)
+        : overlay_(overlay), precision_(precision), max_entries_(max_entries), max_bytes_(max_bytes), yuv_(yuv) {
+}
+
+// 非预乘 RGBA 转为 YUVA444P，色彩矩阵与背景转换一致
+static AVFrame *rgba_to_yuva(const uint8_t *rgba, int width, int height) {
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) {
+        return nullptr;
+    }
+    frame->format = AV_PIX_FMT_YUVA444P;
+    frame->width = width;
+    frame->height = height;
+    struct SwsContext *sws_ctx = sws_getContext(width, height, AV_PIX_FMT_RGBA,
+                                                width, height, AV_PIX_FMT_YUVA444P,
+                                                SWS_BICUBIC, NULL, NULL, NULL);
+    if (!sws_ctx || av_frame_get_buffer(frame, 0) < 0) {
+        sws_freeContext(sws_ctx);
+        av_frame_free(&frame);
+        return nullptr;
+    }
+    const uint8_t *src[1] = {rgba};
+    const int src_linesize[1] = {width * 4};
+    sws_scale(sws_ctx, src, src_linesize, 0, height, frame->data, frame->linesize);
+    sws_freeContext(sws_ctx);
+    return frame;
+}
+
+int64_t OverlayCache::key(double degrees, double *quantized) const {
+    int64_t k;
+    if (precision_ > 0) {
+        k = llround(degrees / precision_);
+        *quantized = k * precision_;
+    } else {
+        // 精确模式直接以 double 的位模式为键
+        memcpy(&k, &degrees, sizeof(k));
+        *quantized = degrees;
+    }
+    return k;
+}
+
+void OverlayCache::evict() {
+    while (!lru_.empty() && (entries_.size() > max_entries_ || bytes_ > max_bytes_)) {
+        auto it = entries_.find(lru_.back());
+        bytes_ -= it->second.overlay->bytes;
+        entries_.erase(it);
+        lru_.pop_back();
+        evictions_++;
+    }
+}
+
+std::shared_ptr<const RotatedOverlay> OverlayCache::get(double degrees) {
+    double quantized;
+    int64_t k = key(degrees, &quantized);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(k);
+        if (it != entries_.end()) {
+            hits_++;
+            lru_.splice(lru_.begin(), lru_, it->second.lru);
+            return it->second.overlay;
+        }
+        misses_++;
+    }
+
+    // 旋转在锁外进行，其他线程可并发命中
+    std::shared_ptr<const RotatedOverlay> rotated = rotate(quantized);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(k);
+    if (it != entries_.end()) {
+        // 另一个线程已插入同一角度
+        return it->second.overlay;
+    }
+    lru_.push_front(k);
+    entries_[k] = Entry{rotated, lru_.begin()};
+    bytes_ += rotated->bytes;
+    evict();
+    return rotated;
+}
+
+std::shared_ptr<const RotatedOverlay> OverlayCache::rotate(double quantized) {
+    // 仅在未命中时经过 GraphicsMagick 旋转，之后导出为预乘 RGBA
+    Magick::Image image = overlay_;
+    image.rotate(quantized); // 角度以度为单位
+
+    auto rotated = std::make_shared<RotatedOverlay>();
+    rotated->width = image.columns();
+    rotated->height = image.rows();
+    rotated->rgba.resize((size_t) rotated->width * rotated->height * 4);
+    image.write(0, 0, rotated->width, rotated->height, "RGBA", Magick::CharPixel, rotated->rgba.data());
+    if (yuv_) {
+        rotated->yuva = rgba_to_yuva(rotated->rgba.data(), rotated->width, rotated->height);
+        if (!rotated->yuva) {
+            throw std::bad_alloc();
+        }
+    }
+    blend_premultiply(rotated->rgba.data(), (size_t) rotated->width * rotated->height);
+    rotated->degrees = quantized;
+    overlay_placement(overlay_.columns(), overlay_.rows(), quantized, &rotated->dx, &rotated->dy);
+    rotated->bytes = rotated->rgba.size() * (yuv_ ? 2 : 1);
+    return rotated;
+}
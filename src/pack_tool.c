@@ -0,0 +1,918 @@
+#define _GNU_SOURCE
+#include "pack_tool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libavutil/avstring.h>
+#include <libavutil/buffer.h>
+#include <libavutil/common.h>
+#include <libavutil/error.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/intreadwrite.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+
+enum {
+    PACK_Y4M,
+    PACK_RAW,
+};
+
+#define Y4M_MAGIC "YUV4MPEG2 "
+#define Y4M_FRAME "FRAME\n"
+#define Y4M_FRAME_HEADER 6
+
+// raw 文件头（小端）：
+//   0 magic[8]  8 version  12 header_size  16 width  20 height  24 pix_fmt[32]
+//   56 frame_rate  64 time_base  72 frame_size  80 frame_stride  88 count  96 table_offset
+// 帧表每项 16 字节：帧在文件中的偏移与 pts
+#define RAW_MAGIC "FXRAWIDX"
+#define RAW_VERSION 1
+#define RAW_HEADER_BYTES 104
+#define RAW_ENTRY_SIZE 16
+// 文件头占一页，帧按页对齐，按帧号读取时不跨多余的页
+#define RAW_ALIGN 4096
+
+// y4m 的 C 标记与像素格式的对应，full_range 的格式写入时带 XCOLORRANGE=FULL
+typedef struct Y4mFormat {
+    enum AVPixelFormat format;
+    const char *tag;
+    int full_range;
+} Y4mFormat;
+
+static const Y4mFormat y4m_formats[] = {
+    {AV_PIX_FMT_YUV420P, "420jpeg", 0},
+    {AV_PIX_FMT_YUVJ420P, "420jpeg", 1},
+    {AV_PIX_FMT_YUV422P, "422", 0},
+    {AV_PIX_FMT_YUVJ422P, "422", 1},
+    {AV_PIX_FMT_YUV444P, "444", 0},
+    {AV_PIX_FMT_YUVJ444P, "444", 1},
+    {AV_PIX_FMT_YUV411P, "411", 0},
+    {AV_PIX_FMT_YUVA444P, "444alpha", 0},
+    {AV_PIX_FMT_GRAY8, "mono", 0},
+    {AV_PIX_FMT_GRAY16LE, "mono16", 0},
+    {AV_PIX_FMT_YUV420P10LE, "420p10", 0},
+    {AV_PIX_FMT_YUV422P10LE, "422p10", 0},
+    {AV_PIX_FMT_YUV444P10LE, "444p10", 0},
+    {AV_PIX_FMT_YUV420P12LE, "420p12", 0},
+    {AV_PIX_FMT_YUV422P12LE, "422p12", 0},
+    {AV_PIX_FMT_YUV444P12LE, "444p12", 0},
+    {AV_PIX_FMT_YUV420P16LE, "420p16", 0},
+    {AV_PIX_FMT_YUV422P16LE, "422p16", 0},
+    {AV_PIX_FMT_YUV444P16LE, "444p16", 0},
+};
+
+static const Y4mFormat *y4m_find_format(enum AVPixelFormat format) {
+    for (int k = 0; k < FF_ARRAY_ELEMS(y4m_formats); k++) {
+        if (y4m_formats[k].format == format) {
+            return &y4m_formats[k];
+        }
+    }
+    return NULL;
+}
+
+static const Y4mFormat *y4m_match_tag(const char *tag, int full_range) {
+    const Y4mFormat *found = NULL;
+    for (int k = 0; k < FF_ARRAY_ELEMS(y4m_formats); k++) {
+        if (strcmp(y4m_formats[k].tag, tag) == 0 && (!found || y4m_formats[k].full_range == full_range)) {
+            found = &y4m_formats[k];
+        }
+    }
+    return found;
+}
+
+static const Y4mFormat *y4m_find_tag(const char *tag, int full_range) {
+    const Y4mFormat *found = y4m_match_tag(tag, full_range);
+    // 420、420mpeg2、420paldv 只是色度位置不同，平面布局与 420jpeg 相同；
+    // 420p10 这类高位深标记上面已经精确匹配，不能落到这里
+    if (!found && (strcmp(tag, "420") == 0 || strcmp(tag, "420mpeg2") == 0 || strcmp(tag, "420paldv") == 0)) {
+        found = y4m_match_tag("420jpeg", full_range);
+    }
+    return found;
+}
+
+static int write_all(int fd, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        ssize_t done = write(fd, data, size);
+        if (done < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return AVERROR(errno);
+        }
+        data += done;
+        size -= done;
+    }
+    return 0;
+}
+
+static int pread_all(int fd, uint8_t *data, size_t size, int64_t offset) {
+    while (size > 0) {
+        ssize_t done = pread(fd, data, size, offset);
+        if (done < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return AVERROR(errno);
+        }
+        if (done == 0) {
+            return AVERROR_EOF;
+        }
+        data += done;
+        size -= done;
+        offset += done;
+    }
+    return 0;
+}
+
+void pack_options_init(PackOptions *opts) {
+    opts->buffer_size = (size_t) 8 << 20;
+    opts->frame_rate = (AVRational) {25, 1};
+    opts->time_base = (AVRational) {1, 25};
+}
+
+int pack_options_parse(PackOptions *opts, const char *name, const char *value) {
+    if (strcmp(name, "pack-buffer-mb") == 0) {
+        int mb = atoi(value);
+        if (mb <= 0) {
+            return AVERROR(EINVAL);
+        }
+        opts->buffer_size = (size_t) mb << 20;
+        return 1;
+    }
+    return 0;
+}
+
+static int pack_type(const char *type) {
+    if (strcmp(type, "y4m") == 0) {
+        return PACK_Y4M;
+    } else if (strcmp(type, "raw") == 0) {
+        return PACK_RAW;
+    }
+    return -1;
+}
+
+int pack_type_supported(const char *type) {
+    return pack_type(type) >= 0;
+}
+
+struct PackWriter {
+    int type;
+    int fd;
+    char path[4096];
+    PackOptions opts;
+    PackInfo info;
+    int laid_out;
+    size_t stride;          // 一帧在文件中占的字节数，y4m 含帧头，raw 含对齐填充
+    int header_size;        // 帧头长度，raw 为 0
+
+    // 写缓冲区，攒满后一次写出
+    uint8_t *buf;
+    size_t buf_size;
+    size_t buf_used;
+    int64_t flushed;        // 已写入文件的字节数
+
+    // raw 帧表
+    uint8_t *table;
+    size_t table_size;
+    int error;
+
+    // 统计
+    int64_t writes;
+    int64_t write_us;
+    int64_t start;
+};
+
+int pack_writer_open(PackWriter **pw, const char *type, const char *path, const PackOptions *opts) {
+    int t = pack_type(type);
+    if (t < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Unknown single-file output type: %s\n", type);
+        return AVERROR(EINVAL);
+    }
+    PackWriter *w = av_mallocz(sizeof(*w));
+    if (!w) {
+        return AVERROR(ENOMEM);
+    }
+    w->type = t;
+    w->opts = *opts;
+    w->info.format = AV_PIX_FMT_NONE;
+    w->info.frame_rate = opts->frame_rate;
+    w->info.time_base = opts->time_base;
+    av_strlcpy(w->path, path, sizeof(w->path));
+    w->buf_size = FFMAX(opts->buffer_size, RAW_ALIGN);
+    w->buf = av_malloc(w->buf_size);
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0 || !w->buf) {
+        int ret = w->fd < 0 ? AVERROR(errno) : AVERROR(ENOMEM);
+        av_log(NULL, AV_LOG_ERROR, "Could not open %s: %s\n", path, av_err2str(ret));
+        w->fd = -1;
+        pack_writer_close(&w);
+        return ret;
+    }
+    w->start = av_gettime_relative();
+    *pw = w;
+    return 0;
+}
+
+static int writer_flush(PackWriter *w) {
+    if (!w->buf_used) {
+        return 0;
+    }
+    int64_t start = av_gettime_relative();
+    int ret = write_all(w->fd, w->buf, w->buf_used);
+    w->write_us += av_gettime_relative() - start;
+    w->writes++;
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Could not write %s: %s\n", w->path, av_err2str(ret));
+        return ret;
+    }
+    w->flushed += w->buf_used;
+    w->buf_used = 0;
+    return 0;
+}
+
+// 在写缓冲区中留出 size 字节，放不下时先写出已有数据，单帧超过缓冲区时扩大缓冲区
+static uint8_t *writer_reserve(PackWriter *w, size_t size) {
+    if (w->buf_used + size > w->buf_size) {
+        w->error = writer_flush(w);
+        if (w->error < 0) {
+            return NULL;
+        }
+    }
+    if (size > w->buf_size) {
+        av_freep(&w->buf);
+        w->buf = av_malloc(size);
+        if (!w->buf) {
+            w->error = AVERROR(ENOMEM);
+            return NULL;
+        }
+        w->buf_size = size;
+    }
+    uint8_t *p = w->buf + w->buf_used;
+    w->buf_used += size;
+    return p;
+}
+
+static void raw_header(const PackWriter *w, uint8_t *p, int64_t table_offset) {
+    const PackInfo *info = &w->info;
+    memset(p, 0, RAW_ALIGN);
+    memcpy(p, RAW_MAGIC, 8);
+    AV_WL32(p + 8, RAW_VERSION);
+    AV_WL32(p + 12, RAW_ALIGN);
+    AV_WL32(p + 16, info->width);
+    AV_WL32(p + 20, info->height);
+    av_strlcpy((char *) p + 24, av_get_pix_fmt_name(info->format), 32);
+    AV_WL32(p + 56, info->frame_rate.num);
+    AV_WL32(p + 60, info->frame_rate.den);
+    AV_WL32(p + 64, info->time_base.num);
+    AV_WL32(p + 68, info->time_base.den);
+    AV_WL64(p + 72, info->frame_size);
+    AV_WL64(p + 80, w->stride);
+    AV_WL64(p + 88, info->count);
+    AV_WL64(p + 96, table_offset);
+}
+
+static int y4m_header(const PackWriter *w, char *p, size_t size) {
+    const PackInfo *info = &w->info;
+    const Y4mFormat *f = y4m_find_format(info->format);
+    return snprintf(p, size, Y4M_MAGIC "W%d H%d F%d:%d Ip A0:0 C%s%s\n",
+                    info->width, info->height, info->frame_rate.num, info->frame_rate.den,
+                    f->tag, f->full_range ? " XCOLORRANGE=FULL" : "");
+}
+
+int pack_writer_layout(PackWriter *w, const AVFrame *frame, int *width, int *height, enum AVPixelFormat *format) {
+    if (!w->laid_out) {
+        PackInfo *info = &w->info;
+        info->width = frame->width;
+        info->height = frame->height;
+        info->format = frame->format;
+        if (w->type == PACK_Y4M && !y4m_find_format(info->format)) {
+            av_log(NULL, AV_LOG_INFO, "y4m: %s is not supported, converting to yuv420p\n",
+                   av_get_pix_fmt_name(info->format));
+            info->format = AV_PIX_FMT_YUV420P;
+        }
+        int size = av_image_get_buffer_size(info->format, info->width, info->height, 1);
+        if (size < 0) {
+            return size;
+        }
+        info->frame_size = size;
+
+        // 文件头先放进写缓冲区，raw 的帧数与帧表位置在关闭时补写
+        if (w->type == PACK_Y4M) {
+            char header[256];
+            int len = y4m_header(w, header, sizeof(header));
+            uint8_t *p = writer_reserve(w, len);
+            if (!p) {
+                return w->error;
+            }
+            memcpy(p, header, len);
+            w->header_size = Y4M_FRAME_HEADER;
+            w->stride = Y4M_FRAME_HEADER + info->frame_size;
+        } else {
+            uint8_t *p = writer_reserve(w, RAW_ALIGN);
+            if (!p) {
+                return w->error;
+            }
+            raw_header(w, p, 0);
+            w->stride = FFALIGN(info->frame_size, RAW_ALIGN);
+        }
+        w->laid_out = 1;
+        av_log(NULL, AV_LOG_INFO, "%s: %dx%d %s, %zu bytes per frame\n",
+               w->path, info->width, info->height, av_get_pix_fmt_name(info->format), w->stride);
+    }
+    *width = w->info.width;
+    *height = w->info.height;
+    *format = w->info.format;
+    return 0;
+}
+
+int pack_writer_write(PackWriter *w, const AVFrame *frame) {
+    if (w->error) {
+        return w->error;
+    }
+    if (!w->laid_out || frame->width != w->info.width || frame->height != w->info.height
+        || frame->format != w->info.format) {
+        return AVERROR(EINVAL);
+    }
+    if (w->type == PACK_RAW && w->table_size < (size_t) (w->info.count + 1) * RAW_ENTRY_SIZE) {
+        size_t size = FFMAX(w->table_size * 2, 1024 * RAW_ENTRY_SIZE);
+        uint8_t *table = av_realloc(w->table, size);
+        if (!table) {
+            return w->error = AVERROR(ENOMEM);
+        }
+        w->table = table;
+        w->table_size = size;
+    }
+
+    uint8_t *p = writer_reserve(w, w->stride);
+    if (!p) {
+        return w->error;
+    }
+    int64_t offset = w->flushed + (p - w->buf);
+    memcpy(p, Y4M_FRAME, w->header_size);
+    int ret = av_image_copy_to_buffer(p + w->header_size, (int) w->info.frame_size,
+                                      (const uint8_t * const *) frame->data, frame->linesize,
+                                      frame->format, frame->width, frame->height, 1);
+    if (ret < 0) {
+        return w->error = ret;
+    }
+    memset(p + w->header_size + w->info.frame_size, 0, w->stride - w->header_size - w->info.frame_size);
+
+    if (w->type == PACK_RAW) {
+        uint8_t *e = w->table + (size_t) w->info.count * RAW_ENTRY_SIZE;
+        AV_WL64(e, offset);
+        AV_WL64(e + 8, frame->pts != AV_NOPTS_VALUE ? frame->pts : w->info.count);
+    }
+    w->info.count++;
+    return 0;
+}
+
+// raw 末尾写帧表，再回到开头补写帧数与帧表位置
+static int raw_finish(PackWriter *w) {
+    int64_t table_offset = w->flushed + w->buf_used;
+    size_t size = (size_t) w->info.count * RAW_ENTRY_SIZE;
+    for (size_t done = 0; done < size;) {
+        size_t n = FFMIN(size - done, w->buf_size);
+        uint8_t *p = writer_reserve(w, n);
+        if (!p) {
+            return w->error;
+        }
+        memcpy(p, w->table + done, n);
+        done += n;
+    }
+    int ret = writer_flush(w);
+    if (ret < 0) {
+        return ret;
+    }
+    uint8_t header[RAW_ALIGN];
+    raw_header(w, header, table_offset);
+    if (pwrite(w->fd, header, RAW_HEADER_BYTES, 0) != RAW_HEADER_BYTES) {
+        ret = AVERROR(errno);
+        av_log(NULL, AV_LOG_ERROR, "Could not write the header of %s: %s\n", w->path, av_err2str(ret));
+        return ret;
+    }
+    return 0;
+}
+
+int pack_writer_close(PackWriter **pw) {
+    PackWriter *w = *pw;
+    if (!w) {
+        return 0;
+    }
+    int ret = w->error;
+    if (w->fd >= 0) {
+        if (!ret && w->laid_out) {
+            ret = w->type == PACK_RAW ? raw_finish(w) : writer_flush(w);
+        }
+        if (close(w->fd) < 0 && !ret) {
+            ret = AVERROR(errno);
+        }
+        double elapsed = (av_gettime_relative() - w->start) / 1000000.0;
+        av_log(NULL, AV_LOG_INFO, "%s: %d frames, %.1f MB in %"PRId64" writes (%.3f s writing, %.3f s total)\n",
+               w->path, w->info.count, w->flushed / 1048576.0, w->writes, w->write_us / 1000000.0, elapsed);
+    }
+    av_free(w->buf);
+    av_free(w->table);
+    av_freep(pw);
+    return ret;
+}
+
+struct PackReader {
+    int type;
+    int fd;
+    char path[4096];
+    PackInfo info;
+    int64_t data_offset;    // 第 0 帧的位置，没有帧表时按 stride 计算
+    size_t stride;
+    int header_size;
+    uint8_t *table;
+    int64_t file_size;
+    AVBufferPool *pool;
+};
+
+// 解析不含换行的 y4m 文件头，设置宽高、像素格式、帧率与帧长度，line 会被改写
+static int y4m_parse_header(char *line, PackInfo *info, const char *path) {
+    char tag[32] = "420jpeg";
+    int full_range = 0;
+    info->frame_rate = (AVRational) {25, 1};
+    char *save = NULL;
+    for (char *tok = av_strtok(line + strlen(Y4M_MAGIC), " ", &save); tok; tok = av_strtok(NULL, " ", &save)) {
+        switch (tok[0]) {
+            case 'W':
+                info->width = atoi(tok + 1);
+                break;
+            case 'H':
+                info->height = atoi(tok + 1);
+                break;
+            case 'F':
+                sscanf(tok + 1, "%d:%d", &info->frame_rate.num, &info->frame_rate.den);
+                break;
+            case 'C':
+                av_strlcpy(tag, tok + 1, sizeof(tag));
+                break;
+            case 'X':
+                full_range |= strcmp(tok, "XCOLORRANGE=FULL") == 0;
+                break;
+        }
+    }
+    const Y4mFormat *f = y4m_find_tag(tag, full_range);
+    if (!f || info->width <= 0 || info->height <= 0 || info->frame_rate.num <= 0 || info->frame_rate.den <= 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: unsupported y4m header (%dx%d, C%s)\n",
+               path, info->width, info->height, tag);
+        return AVERROR_INVALIDDATA;
+    }
+    info->format = f->format;
+    info->time_base = av_inv_q(info->frame_rate);
+    int frame_size = av_image_get_buffer_size(info->format, info->width, info->height, 1);
+    if (frame_size < 0) {
+        return frame_size;
+    }
+    info->frame_size = frame_size;
+    return 0;
+}
+
+// 只支持不带帧参数的 FRAME 头，这样每帧长度相同，可按帧号定位
+static int y4m_open(PackReader *r, const uint8_t *head, size_t size) {
+    const uint8_t *end = memchr(head, '\n', size);
+    if (!end) {
+        av_log(NULL, AV_LOG_ERROR, "%s: y4m header too long\n", r->path);
+        return AVERROR_INVALIDDATA;
+    }
+    char line[RAW_ALIGN];
+    size_t len = end - head;
+    memcpy(line, head, len);
+    line[len] = 0;
+
+    PackInfo *info = &r->info;
+    int ret = y4m_parse_header(line, info, r->path);
+    if (ret < 0) {
+        return ret;
+    }
+    r->header_size = Y4M_FRAME_HEADER;
+    r->stride = Y4M_FRAME_HEADER + info->frame_size;
+    r->data_offset = len + 1;
+    info->count = (int) (FFMAX(r->file_size - r->data_offset, 0) / r->stride);
+
+    if (info->count > 0) {
+        uint8_t frame_header[Y4M_FRAME_HEADER];
+        ret = pread_all(r->fd, frame_header, sizeof(frame_header), r->data_offset);
+        if (ret < 0 || memcmp(frame_header, Y4M_FRAME, Y4M_FRAME_HEADER) != 0) {
+            av_log(NULL, AV_LOG_ERROR, "%s: y4m frame parameters are not supported\n", r->path);
+            return AVERROR_PATCHWELCOME;
+        }
+    }
+    return 0;
+}
+
+static int raw_open(PackReader *r, const uint8_t *head, size_t size) {
+    PackInfo *info = &r->info;
+    if (size < RAW_HEADER_BYTES || AV_RL32(head + 8) != RAW_VERSION) {
+        av_log(NULL, AV_LOG_ERROR, "%s: unsupported raw version\n", r->path);
+        return AVERROR_INVALIDDATA;
+    }
+    char name[33];
+    memcpy(name, head + 24, 32);
+    name[32] = 0;
+    r->data_offset = AV_RL32(head + 12);
+    info->width = AV_RL32(head + 16);
+    info->height = AV_RL32(head + 20);
+    info->format = av_get_pix_fmt(name);
+    info->frame_rate = (AVRational) {(int) AV_RL32(head + 56), (int) AV_RL32(head + 60)};
+    info->time_base = (AVRational) {(int) AV_RL32(head + 64), (int) AV_RL32(head + 68)};
+    info->frame_size = AV_RL64(head + 72);
+    r->stride = AV_RL64(head + 80);
+    uint64_t count = AV_RL64(head + 88);
+    int64_t table_offset = AV_RL64(head + 96);
+
+    int frame_size = av_image_get_buffer_size(info->format, info->width, info->height, 1);
+    if (info->format == AV_PIX_FMT_NONE || frame_size < 0 || (size_t) frame_size != info->frame_size
+        || r->stride < info->frame_size || count > INT_MAX) {
+        av_log(NULL, AV_LOG_ERROR, "%s: invalid raw header\n", r->path);
+        return AVERROR_INVALIDDATA;
+    }
+
+    // 写入中途退出的文件没有帧表，帧仍然是定长的，按 stride 计算帧数与位置
+    if (!table_offset) {
+        info->count = (int) (FFMAX(r->file_size - r->data_offset, 0) / r->stride);
+        av_log(NULL, AV_LOG_WARNING, "%s: no frame table, assuming %d frames\n", r->path, info->count);
+        return 0;
+    }
+    info->count = (int) count;
+    r->table = av_malloc_array(count ? count : 1, RAW_ENTRY_SIZE);
+    if (!r->table) {
+        return AVERROR(ENOMEM);
+    }
+    int ret = pread_all(r->fd, r->table, count * RAW_ENTRY_SIZE, table_offset);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: could not read the frame table: %s\n", r->path, av_err2str(ret));
+        return ret;
+    }
+    return 0;
+}
+
+int pack_probe(const char *path) {
+    struct stat st;
+    if (stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
+        return 0;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    uint8_t head[10];
+    int ret = pread_all(fd, head, sizeof(head), 0) >= 0
+              && (memcmp(head, Y4M_MAGIC, 10) == 0 || memcmp(head, RAW_MAGIC, 8) == 0);
+    close(fd);
+    return ret;
+}
+
+int pack_reader_open(PackReader **pr, const char *path) {
+    PackReader *r = av_mallocz(sizeof(*r));
+    if (!r) {
+        return AVERROR(ENOMEM);
+    }
+    av_strlcpy(r->path, path, sizeof(r->path));
+    int ret;
+    struct stat st;
+    r->fd = open(path, O_RDONLY);
+    if (r->fd < 0 || fstat(r->fd, &st) < 0) {
+        ret = AVERROR(errno);
+        av_log(NULL, AV_LOG_ERROR, "Could not open %s: %s\n", path, av_err2str(ret));
+        goto fail;
+    }
+    r->file_size = st.st_size;
+
+    uint8_t head[RAW_ALIGN];
+    size_t size = FFMIN((int64_t) sizeof(head), r->file_size);
+    ret = pread_all(r->fd, head, size, 0);
+    if (ret < 0) {
+        goto fail;
+    }
+    if (size >= 10 && memcmp(head, Y4M_MAGIC, 10) == 0) {
+        r->type = PACK_Y4M;
+        ret = y4m_open(r, head, size);
+    } else if (size >= 8 && memcmp(head, RAW_MAGIC, 8) == 0) {
+        r->type = PACK_RAW;
+        ret = raw_open(r, head, size);
+    } else {
+        av_log(NULL, AV_LOG_ERROR, "%s is neither y4m nor raw\n", path);
+        ret = AVERROR_INVALIDDATA;
+    }
+    if (ret < 0) {
+        goto fail;
+    }
+
+    // 每帧一块连续的缓冲区，整帧一次读入，各平面直接指向其中
+    r->pool = av_buffer_pool_init(r->stride + 64, NULL);
+    if (!r->pool) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    av_log(NULL, AV_LOG_INFO, "%s: %s %dx%d %s, %d frames\n", path, r->type == PACK_Y4M ? "y4m" : "raw",
+           r->info.width, r->info.height, av_get_pix_fmt_name(r->info.format), r->info.count);
+    *pr = r;
+    return 0;
+fail:
+    pack_reader_close(&r);
+    return ret;
+}
+
+const PackInfo *pack_reader_info(const PackReader *r) {
+    return &r->info;
+}
+
+int pack_reader_read(PackReader *r, int index, AVFrame *frame) {
+    if (index < 0 || index >= r->info.count) {
+        return AVERROR(EINVAL);
+    }
+    int64_t offset = r->data_offset + (int64_t) index * r->stride;
+    int64_t pts = index;
+    if (r->table) {
+        const uint8_t *e = r->table + (size_t) index * RAW_ENTRY_SIZE;
+        offset = AV_RL64(e);
+        pts = AV_RL64(e + 8);
+    }
+
+    AVBufferRef *buf = av_buffer_pool_get(r->pool);
+    if (!buf) {
+        return AVERROR(ENOMEM);
+    }
+    size_t size = r->header_size + r->info.frame_size;
+    int ret = pread_all(r->fd, buf->data, size, offset);
+    if (ret >= 0 && r->header_size && memcmp(buf->data, Y4M_FRAME, r->header_size) != 0) {
+        ret = AVERROR_INVALIDDATA;
+    }
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: could not read frame %d: %s\n", r->path, index, av_err2str(ret));
+        av_buffer_unref(&buf);
+        return ret;
+    }
+
+    av_frame_unref(frame);
+    frame->buf[0] = buf;
+    frame->width = r->info.width;
+    frame->height = r->info.height;
+    frame->format = r->info.format;
+    frame->pts = pts;
+    ret = av_image_fill_arrays(frame->data, frame->linesize, buf->data + r->header_size,
+                               r->info.format, r->info.width, r->info.height, 1);
+    if (ret < 0) {
+        av_frame_unref(frame);
+        return ret;
+    }
+    return 0;
+}
+
+void pack_reader_close(PackReader **pr) {
+    PackReader *r = *pr;
+    if (!r) {
+        return;
+    }
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+    av_buffer_pool_uninit(&r->pool);
+    av_free(r->table);
+    av_freep(pr);
+}
+
+// 流读缓冲区的大小，文件头与帧头从这里解析，帧的像素尽量直接读进帧缓冲区
+#define STREAM_BUFFER_SIZE (64 << 10)
+// 管道缓冲区扩大到这么多，上游可以多写一些再等待
+#define STREAM_PIPE_SIZE (1 << 20)
+
+struct PackStream {
+    int fd;
+    char path[4096];
+    PackInfo info;
+    int y4m;
+    uint8_t *buf;
+    size_t buf_pos;
+    size_t buf_len;
+    AVBufferPool *pool;
+
+    // 统计
+    int64_t frames;
+    int64_t reads;
+    int64_t bytes;
+    int64_t wait_us;
+};
+
+// 调用一次 read，返回读到的字节数，0 为流结束
+static ssize_t stream_read_some(PackStream *s, uint8_t *dst, size_t size) {
+    int64_t start = av_gettime_relative();
+    ssize_t done;
+    do {
+        done = read(s->fd, dst, size);
+    } while (done < 0 && errno == EINTR);
+    s->wait_us += av_gettime_relative() - start;
+    if (done < 0) {
+        return AVERROR(errno);
+    }
+    s->reads++;
+    s->bytes += done;
+    return done;
+}
+
+// 读缓冲区中至少有 size 字节可用，流提前结束时返回 AVERROR_EOF
+static int stream_want(PackStream *s, size_t size) {
+    if (s->buf_len - s->buf_pos >= size) {
+        return 0;
+    }
+    memmove(s->buf, s->buf + s->buf_pos, s->buf_len - s->buf_pos);
+    s->buf_len -= s->buf_pos;
+    s->buf_pos = 0;
+    while (s->buf_len < size) {
+        ssize_t done = stream_read_some(s, s->buf + s->buf_len, STREAM_BUFFER_SIZE - s->buf_len);
+        if (done <= 0) {
+            return done < 0 ? (int) done : AVERROR_EOF;
+        }
+        s->buf_len += done;
+    }
+    return 0;
+}
+
+// 读一行到 line（不含换行），行首就遇到流结束时返回 AVERROR_EOF
+static int stream_line(PackStream *s, char *line, size_t size) {
+    for (;;) {
+        uint8_t *p = s->buf + s->buf_pos;
+        uint8_t *end = memchr(p, '\n', s->buf_len - s->buf_pos);
+        if (end) {
+            size_t len = end - p;
+            if (len >= size) {
+                break;
+            }
+            memcpy(line, p, len);
+            line[len] = 0;
+            s->buf_pos += len + 1;
+            return 0;
+        }
+        size_t avail = s->buf_len - s->buf_pos;
+        if (avail >= size) {
+            break;
+        }
+        int ret = stream_want(s, avail + 1);
+        if (ret < 0) {
+            return ret == AVERROR_EOF && avail ? AVERROR_INVALIDDATA : ret;
+        }
+    }
+    av_log(NULL, AV_LOG_ERROR, "%s: y4m header too long\n", s->path);
+    return AVERROR_INVALIDDATA;
+}
+
+// 先取走读缓冲区中剩余的部分，其余直接从流读进 dst
+static int stream_read_exact(PackStream *s, uint8_t *dst, size_t size) {
+    size_t n = FFMIN(size, s->buf_len - s->buf_pos);
+    memcpy(dst, s->buf + s->buf_pos, n);
+    s->buf_pos += n;
+    for (size_t done = n; done < size;) {
+        ssize_t got = stream_read_some(s, dst + done, size - done);
+        if (got < 0) {
+            return (int) got;
+        }
+        if (got == 0) {
+            return done ? AVERROR_INVALIDDATA : AVERROR_EOF;
+        }
+        done += got;
+    }
+    return 0;
+}
+
+int pack_stream_open(PackStream **ps, const char *path, int width, int height, enum AVPixelFormat format) {
+    PackStream *s = av_mallocz(sizeof(*s));
+    if (!s) {
+        return AVERROR(ENOMEM);
+    }
+    int ret;
+    av_strlcpy(s->path, path, sizeof(s->path));
+    s->fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    s->buf = av_malloc(STREAM_BUFFER_SIZE);
+    if (s->fd < 0 || !s->buf) {
+        ret = s->fd < 0 ? AVERROR(errno) : AVERROR(ENOMEM);
+        av_log(NULL, AV_LOG_ERROR, "Could not open %s: %s\n", path, av_err2str(ret));
+        goto fail;
+    }
+#ifdef F_SETPIPE_SZ
+    struct stat st;
+    if (fstat(s->fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        // 失败（超过 pipe-max-size）时保持默认大小
+        fcntl(s->fd, F_SETPIPE_SZ, STREAM_PIPE_SIZE);
+    }
+#endif
+
+    // 看开头是不是 y4m 文件头，不是时这些字节留在读缓冲区里作为第一帧的开头
+    ret = stream_want(s, strlen(Y4M_MAGIC));
+    if (ret < 0 && ret != AVERROR_EOF) {
+        goto fail;
+    }
+    s->y4m = ret >= 0 && memcmp(s->buf, Y4M_MAGIC, strlen(Y4M_MAGIC)) == 0;
+    if (s->y4m) {
+        char line[1024];
+        ret = stream_line(s, line, sizeof(line));
+        if (ret >= 0) {
+            ret = y4m_parse_header(line, &s->info, path);
+        }
+        if (ret < 0) {
+            goto fail;
+        }
+    } else {
+        int size = width > 0 && height > 0 && format != AV_PIX_FMT_NONE
+                   ? av_image_get_buffer_size(format, width, height, 1) : AVERROR(EINVAL);
+        if (size < 0) {
+            av_log(NULL, AV_LOG_ERROR, "%s is not y4m, raw input needs its size and pixel format\n", path);
+            ret = AVERROR(EINVAL);
+            goto fail;
+        }
+        s->info.width = width;
+        s->info.height = height;
+        s->info.format = format;
+        s->info.frame_rate = (AVRational) {25, 1};
+        s->info.time_base = (AVRational) {1, 25};
+        s->info.frame_size = size;
+    }
+
+    s->pool = av_buffer_pool_init(s->info.frame_size + 64, NULL);
+    if (!s->pool) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    av_log(NULL, AV_LOG_INFO, "%s: %s stream %dx%d %s\n", path, s->y4m ? "y4m" : "raw",
+           s->info.width, s->info.height, av_get_pix_fmt_name(s->info.format));
+    *ps = s;
+    return 0;
+fail:
+    pack_stream_close(&s);
+    return ret;
+}
+
+const PackInfo *pack_stream_info(const PackStream *s) {
+    return &s->info;
+}
+
+int pack_stream_read(PackStream *s, AVFrame *frame) {
+    int ret;
+    if (s->y4m) {
+        // 流是顺序读的，帧头可以带参数，忽略即可
+        char line[1024];
+        ret = stream_line(s, line, sizeof(line));
+        if (ret < 0) {
+            return ret;
+        }
+        if (strncmp(line, "FRAME", 5) != 0) {
+            av_log(NULL, AV_LOG_ERROR, "%s: bad y4m frame header after frame %"PRId64"\n", s->path, s->frames);
+            return AVERROR_INVALIDDATA;
+        }
+    }
+
+    AVBufferRef *buf = av_buffer_pool_get(s->pool);
+    if (!buf) {
+        return AVERROR(ENOMEM);
+    }
+    ret = stream_read_exact(s, buf->data, s->info.frame_size);
+    if (ret < 0) {
+        if (ret != AVERROR_EOF || s->y4m) {
+            av_log(NULL, AV_LOG_ERROR, "%s: truncated frame %"PRId64"\n", s->path, s->frames);
+            ret = ret == AVERROR_EOF ? AVERROR_INVALIDDATA : ret;
+        }
+        av_buffer_unref(&buf);
+        return ret;
+    }
+
+    av_frame_unref(frame);
+    frame->buf[0] = buf;
+    frame->width = s->info.width;
+    frame->height = s->info.height;
+    frame->format = s->info.format;
+    frame->pts = s->frames++;
+    ret = av_image_fill_arrays(frame->data, frame->linesize, buf->data,
+                               s->info.format, s->info.width, s->info.height, 1);
+    if (ret < 0) {
+        av_frame_unref(frame);
+        return ret;
+    }
+    return 0;
+}
+
+void pack_stream_close(PackStream **ps) {
+    PackStream *s = *ps;
+    if (!s) {
+        return;
+    }
+    if (s->pool) {
+        av_log(NULL, AV_LOG_INFO, "%s: %"PRId64" frames, %.1f MB in %"PRId64" reads, %.3f s waiting for input\n",
+               s->path, s->frames, s->bytes / 1048576.0, s->reads, s->wait_us / 1000000.0);
+    }
+    if (s->fd > STDIN_FILENO) {
+        close(s->fd);
+    }
+    av_buffer_pool_uninit(&s->pool);
+    av_free(s->buf);
+    av_freep(ps);
+}
@@ -0,0 +1,353 @@
+#include "png_tool.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <png.h>
+
+#include <libavutil/avstring.h>
+#include <libavutil/common.h>
+#include <libavutil/cpu.h>
+#include <libavutil/error.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+
+typedef struct PngJob {
+    AVFrame *frame;
+    char filename[4096];
+} PngJob;
+
+struct PngWriter {
+    PngOptions opts;
+    int depth;
+
+    pthread_t *threads;
+    int nb_started;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t space;
+    AVFrame **frames;       // 全部帧，关闭时统一释放
+    AVFrame **free_frames;  // 空闲帧栈
+    int nb_free;
+    PngJob *jobs;           // 待写入的环形队列，长度不超过 depth
+    int head;
+    int count;
+    int eof;
+    int error;
+
+    // 统计
+    int64_t written;
+    int64_t busy_us;
+    int64_t get_stalls;
+    int64_t get_wait_us;
+};
+
+typedef struct NamedValue {
+    const char *name;
+    int value;
+} NamedValue;
+
+static const NamedValue strategies[] = {
+    {"default",  Z_DEFAULT_STRATEGY},
+    {"filtered", Z_FILTERED},
+    {"huffman",  Z_HUFFMAN_ONLY},
+    {"rle",      Z_RLE},
+    {"fixed",    Z_FIXED},
+};
+
+static const NamedValue filters[] = {
+    {"none",  PNG_FILTER_NONE},
+    {"sub",   PNG_FILTER_SUB},
+    {"up",    PNG_FILTER_UP},
+    {"avg",   PNG_FILTER_AVG},
+    {"paeth", PNG_FILTER_PAETH},
+    {"all",   PNG_ALL_FILTERS},
+};
+
+static int find_value(const NamedValue *table, int n, const char *name, const char *value, int *out) {
+    for (int k = 0; k < n; k++) {
+        if (strcmp(table[k].name, value) == 0) {
+            *out = table[k].value;
+            return 1;
+        }
+    }
+    av_log(NULL, AV_LOG_ERROR, "invalid value for %s: %s\n", name, value);
+    return AVERROR(EINVAL);
+}
+
+void png_options_init(PngOptions *opts) {
+    opts->level = -1;
+    opts->strategy = -1;
+    opts->filter = -1;
+    opts->threads = av_cpu_count();
+    opts->queue = 0;
+}
+
+int png_options_parse(PngOptions *opts, const char *name, const char *value) {
+    if (strcmp(name, "png-level") == 0) {
+        opts->level = atoi(value);
+        if (opts->level < 0 || opts->level > 9) {
+            av_log(NULL, AV_LOG_ERROR, "invalid value for %s: %s\n", name, value);
+            return AVERROR(EINVAL);
+        }
+    } else if (strcmp(name, "png-strategy") == 0) {
+        return find_value(strategies, FF_ARRAY_ELEMS(strategies), name, value, &opts->strategy);
+    } else if (strcmp(name, "png-filter") == 0) {
+        return find_value(filters, FF_ARRAY_ELEMS(filters), name, value, &opts->filter);
+    } else if (strcmp(name, "png-preset") == 0) {
+        if (strcmp(value, "fast") == 0) {
+            // 临时导出用，体积大一些但压缩快得多
+            opts->level = 1;
+            opts->strategy = Z_RLE;
+            opts->filter = PNG_FILTER_SUB;
+        } else if (strcmp(value, "small") == 0) {
+            opts->level = 9;
+            opts->strategy = Z_DEFAULT_STRATEGY;
+            opts->filter = PNG_ALL_FILTERS;
+        } else {
+            av_log(NULL, AV_LOG_ERROR, "invalid value for %s: %s\n", name, value);
+            return AVERROR(EINVAL);
+        }
+    } else if (strcmp(name, "png-threads") == 0) {
+        opts->threads = atoi(value);
+        if (opts->threads < 0) {
+            return AVERROR(EINVAL);
+        }
+    } else if (strcmp(name, "png-queue") == 0) {
+        opts->queue = atoi(value);
+        if (opts->queue < 0) {
+            return AVERROR(EINVAL);
+        }
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+int png_write_frame(const char *filename, const AVFrame *frame, const PngOptions *opts) {
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        int ret = AVERROR(errno);
+        av_log(NULL, AV_LOG_ERROR, "Failed to open file %s: %s\n", filename, av_err2str(ret));
+        return ret;
+    }
+
+    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png_ptr) {
+        fclose(fp);
+        av_log(NULL, AV_LOG_ERROR, "png_create_write_struct failed\n");
+        return AVERROR(ENOMEM);
+    }
+
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr) {
+        png_destroy_write_struct(&png_ptr, NULL);
+        fclose(fp);
+        av_log(NULL, AV_LOG_ERROR, "png_create_info_struct failed\n");
+        return AVERROR(ENOMEM);
+    }
+
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        fclose(fp);
+        av_log(NULL, AV_LOG_ERROR, "Error during png writing: %s\n", filename);
+        return AVERROR_EXTERNAL;
+    }
+
+    png_init_io(png_ptr, fp);
+
+    // 未指定的参数保持 libpng 默认，与原先的串行输出一致
+    if (opts->level >= 0) {
+        png_set_compression_level(png_ptr, opts->level);
+    }
+    if (opts->strategy >= 0) {
+        png_set_compression_strategy(png_ptr, opts->strategy);
+    }
+    if (opts->filter >= 0) {
+        png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, opts->filter);
+    }
+
+    // 设置PNG图像的相关信息
+    png_set_IHDR(png_ptr, info_ptr, frame->width, frame->height,
+                 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+
+    png_write_info(png_ptr, info_ptr);
+
+    for (int y = 0; y < frame->height; y++) {
+        png_write_row(png_ptr, frame->data[0] + y * frame->linesize[0]);
+    }
+
+    png_write_end(png_ptr, NULL);
+
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    if (fclose(fp) != 0) {
+        return AVERROR(errno);
+    }
+    return 0;
+}
+
+static void put_free(PngWriter *w, AVFrame *frame) {
+    w->free_frames[w->nb_free++] = frame;
+    pthread_cond_signal(&w->space);
+}
+
+static void *png_worker(void *arg) {
+    PngWriter *w = arg;
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->count && !w->eof) {
+            pthread_cond_wait(&w->work, &w->lock);
+        }
+        if (!w->count) {
+            break;
+        }
+        PngJob *job = &w->jobs[w->head];
+        w->head = (w->head + 1) % w->depth;
+        w->count--;
+        // 出错后不再写后续帧，只回收缓冲区
+        int skip = w->error;
+        pthread_mutex_unlock(&w->lock);
+
+        int64_t start = av_gettime_relative();
+        int ret = skip ? 0 : png_write_frame(job->filename, job->frame, &w->opts);
+        int64_t busy = av_gettime_relative() - start;
+
+        pthread_mutex_lock(&w->lock);
+        w->busy_us += busy;
+        if (ret < 0) {
+            if (!w->error) {
+                w->error = ret;
+            }
+        } else if (!skip) {
+            w->written++;
+        }
+        put_free(w, job->frame);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+int png_writer_start(PngWriter **pw, const PngOptions *opts) {
+    PngWriter *w = av_mallocz(sizeof(*w));
+    if (!w) {
+        return AVERROR(ENOMEM);
+    }
+    w->opts = *opts;
+    w->depth = opts->threads ? (opts->queue ? opts->queue : opts->threads * 2) : 1;
+    w->depth = FFMAX(w->depth, opts->threads);
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->work, NULL);
+    pthread_cond_init(&w->space, NULL);
+    w->frames = av_calloc(w->depth, sizeof(*w->frames));
+    w->free_frames = av_calloc(w->depth, sizeof(*w->free_frames));
+    w->jobs = av_calloc(w->depth, sizeof(*w->jobs));
+    w->threads = av_calloc(FFMAX(opts->threads, 1), sizeof(*w->threads));
+    if (!w->frames || !w->free_frames || !w->jobs || !w->threads) {
+        png_writer_close(&w);
+        return AVERROR(ENOMEM);
+    }
+    for (int k = 0; k < w->depth; k++) {
+        w->frames[k] = av_frame_alloc();
+        if (!w->frames[k]) {
+            png_writer_close(&w);
+            return AVERROR(ENOMEM);
+        }
+        w->free_frames[w->nb_free++] = w->frames[k];
+    }
+    for (int k = 0; k < opts->threads; k++) {
+        int ret = pthread_create(&w->threads[k], NULL, png_worker, w);
+        if (ret != 0) {
+            png_writer_close(&w);
+            return AVERROR(ret);
+        }
+        w->nb_started++;
+    }
+    *pw = w;
+    return 0;
+}
+
+int png_writer_get(PngWriter *w, AVFrame **frame) {
+    pthread_mutex_lock(&w->lock);
+    if (!w->nb_free && !w->error) {
+        // 写线程跟不上，解码线程等待空闲帧
+        int64_t start = av_gettime_relative();
+        while (!w->nb_free && !w->error) {
+            pthread_cond_wait(&w->space, &w->lock);
+        }
+        w->get_stalls++;
+        w->get_wait_us += av_gettime_relative() - start;
+    }
+    int ret = w->error;
+    if (!ret) {
+        *frame = w->free_frames[--w->nb_free];
+    }
+    pthread_mutex_unlock(&w->lock);
+    return ret;
+}
+
+int png_writer_submit(PngWriter *w, AVFrame *frame, const char *filename) {
+    if (!w->nb_started) {
+        int64_t start = av_gettime_relative();
+        int ret = png_write_frame(filename, frame, &w->opts);
+        pthread_mutex_lock(&w->lock);
+        w->busy_us += av_gettime_relative() - start;
+        if (ret < 0) {
+            w->error = ret;
+        } else {
+            w->written++;
+        }
+        put_free(w, frame);
+        pthread_mutex_unlock(&w->lock);
+        return ret;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    PngJob *job = &w->jobs[(w->head + w->count) % w->depth];
+    job->frame = frame;
+    av_strlcpy(job->filename, filename, sizeof(job->filename));
+    w->count++;
+    pthread_cond_signal(&w->work);
+    int ret = w->error;
+    pthread_mutex_unlock(&w->lock);
+    return ret;
+}
+
+int png_writer_close(PngWriter **pw) {
+    PngWriter *w = *pw;
+    if (!w) {
+        return 0;
+    }
+    pthread_mutex_lock(&w->lock);
+    w->eof = 1;
+    pthread_cond_broadcast(&w->work);
+    pthread_mutex_unlock(&w->lock);
+    for (int k = 0; k < w->nb_started; k++) {
+        pthread_join(w->threads[k], NULL);
+    }
+    av_log(NULL, AV_LOG_INFO,
+           "png writer: %d threads, queue %d, %"PRId64" files, compressing %.3f s, "
+           "decoder stalled %"PRId64" times (%.3f s)\n",
+           w->nb_started, w->depth, w->written, w->busy_us / 1000000.0,
+           w->get_stalls, w->get_wait_us / 1000000.0);
+    int ret = w->error;
+    if (w->frames) {
+        for (int k = 0; k < w->depth; k++) {
+            av_frame_free(&w->frames[k]);
+        }
+    }
+    av_free(w->frames);
+    av_free(w->free_frames);
+    av_free(w->jobs);
+    av_free(w->threads);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->work);
+    pthread_cond_destroy(&w->space);
+    av_freep(pw);
+    return ret;
+}
@@ -0,0 +1,175 @@
+#include "pool_tool.h"
+
+#include <errno.h>
+#include <pthread.h>
+
+#include <libavutil/common.h>
+#include <libavutil/error.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+
+typedef struct PoolWorker {
+    JobPool *pool;
+    int id;
+    pthread_t thread;
+} PoolWorker;
+
+struct JobPool {
+    PoolJob job;
+    void *opaque;
+    int depth;
+    int total;
+
+    PoolWorker *workers;
+    int nb_workers;
+    int nb_started;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int next;           // 下一个待领取的序号
+    int *free_for;      // 槽位可供哪个序号使用
+    int *ready;         // 槽位中已完成的序号，-1 为无
+    int error;
+    int aborted;
+
+    // 统计
+    int64_t busy_us;
+    int64_t slot_wait_us;
+    int64_t take_wait_us;
+    int64_t take_stalls;
+};
+
+static void *pool_worker(void *arg) {
+    PoolWorker *w = arg;
+    JobPool *pool = w->pool;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        if (pool->aborted || pool->error || pool->next >= pool->total) {
+            break;
+        }
+        int index = pool->next++;
+        int slot = index % pool->depth;
+
+        // 等消费者释放该槽位的上一个任务
+        if (pool->free_for[slot] != index) {
+            int64_t start = av_gettime_relative();
+            while (pool->free_for[slot] != index && !pool->aborted && !pool->error) {
+                pthread_cond_wait(&pool->cond, &pool->lock);
+            }
+            pool->slot_wait_us += av_gettime_relative() - start;
+            if (pool->aborted || pool->error) {
+                break;
+            }
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        int64_t start = av_gettime_relative();
+        int ret = pool->job(pool->opaque, w->id, index, slot);
+        int64_t busy = av_gettime_relative() - start;
+
+        pthread_mutex_lock(&pool->lock);
+        pool->busy_us += busy;
+        if (ret < 0) {
+            if (!pool->error) {
+                pool->error = ret;
+            }
+        } else {
+            pool->ready[slot] = index;
+        }
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int pool_start(JobPool **ppool, int workers, int depth, int total, PoolJob job, void *opaque) {
+    JobPool *pool = av_mallocz(sizeof(*pool));
+    if (!pool) {
+        return AVERROR(ENOMEM);
+    }
+    pool->job = job;
+    pool->opaque = opaque;
+    pool->nb_workers = FFMAX(workers, 1);
+    pool->depth = FFMAX(depth, 1);
+    pool->total = total;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    pool->workers = av_calloc(pool->nb_workers, sizeof(*pool->workers));
+    pool->free_for = av_calloc(pool->depth, sizeof(*pool->free_for));
+    pool->ready = av_calloc(pool->depth, sizeof(*pool->ready));
+    if (!pool->workers || !pool->free_for || !pool->ready) {
+        pool_stop(&pool);
+        return AVERROR(ENOMEM);
+    }
+    for (int s = 0; s < pool->depth; s++) {
+        pool->free_for[s] = s;
+        pool->ready[s] = -1;
+    }
+    for (int k = 0; k < pool->nb_workers; k++) {
+        PoolWorker *w = &pool->workers[k];
+        w->pool = pool;
+        w->id = k;
+        int ret = pthread_create(&w->thread, NULL, pool_worker, w);
+        if (ret != 0) {
+            pool_stop(&pool);
+            return AVERROR(ret);
+        }
+        pool->nb_started++;
+    }
+    *ppool = pool;
+    return 0;
+}
+
+int pool_take(JobPool *pool, int index) {
+    int slot = index % pool->depth;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->ready[slot] != index) {
+        // 结果还没出来，消费者等待
+        int64_t start = av_gettime_relative();
+        while (pool->ready[slot] != index && !pool->error && !pool->aborted) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        pool->take_stalls++;
+        pool->take_wait_us += av_gettime_relative() - start;
+    }
+    int ret = pool->ready[slot] == index ? slot : pool->error ? pool->error : AVERROR_EXIT;
+    pthread_mutex_unlock(&pool->lock);
+    return ret;
+}
+
+void pool_release(JobPool *pool, int index) {
+    int slot = index % pool->depth;
+    pthread_mutex_lock(&pool->lock);
+    pool->ready[slot] = -1;
+    pool->free_for[slot] = index + pool->depth;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_stop(JobPool **ppool) {
+    JobPool *pool = *ppool;
+    if (!pool) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->aborted = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (int k = 0; k < pool->nb_started; k++) {
+        pthread_join(pool->workers[k].thread, NULL);
+    }
+    if (pool->nb_started) {
+        av_log(NULL, AV_LOG_INFO,
+               "pool: %d workers, depth %d, busy %.3f s, waiting for slots %.3f s, "
+               "consumer stalled %"PRId64" times (%.3f s)\n",
+               pool->nb_workers, pool->depth, pool->busy_us / 1000000.0, pool->slot_wait_us / 1000000.0,
+               pool->take_stalls, pool->take_wait_us / 1000000.0);
+    }
+    av_free(pool->workers);
+    av_free(pool->free_for);
+    av_free(pool->ready);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->cond);
+    av_freep(ppool);
+}
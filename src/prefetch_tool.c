@@ -0,0 +1,300 @@
+#include "prefetch_tool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libavutil/common.h>
+#include <libavutil/error.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+
+enum {
+    SLOT_EMPTY,
+    SLOT_READY,
+    SLOT_IN_USE,
+};
+
+typedef struct PrefetchSlot {
+    PrefetchBuf buf;
+    int state;
+    int error;
+    void *map;
+} PrefetchSlot;
+
+struct Prefetcher {
+    const FrameSeq *seq;
+    int count;
+    int depth;
+    PrefetchSlot *slots;
+
+    pthread_t thread;
+    int thread_started;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t space;
+    int aborted;
+
+    // 统计
+    int64_t hits;
+    int64_t stalls;
+    int64_t stall_us;
+    int64_t bytes;
+    int64_t read_us;
+};
+
+// 打开文件并整体映射，MAP_POPULATE 让缺页在预读线程里完成
+static int load_file(const char *path, PrefetchSlot *slot) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return AVERROR(errno);
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        int err = AVERROR(errno);
+        close(fd);
+        return err;
+    }
+    slot->map = NULL;
+    slot->buf.size = st.st_size;
+    if (st.st_size > 0) {
+        posix_fadvise(fd, 0, st.st_size, POSIX_FADV_WILLNEED);
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if (map == MAP_FAILED) {
+            int err = AVERROR(errno);
+            close(fd);
+            return err;
+        }
+        slot->map = map;
+    }
+    close(fd);
+    slot->buf.data = slot->map;
+    return 0;
+}
+
+static void *prefetch_thread(void *arg) {
+    Prefetcher *pf = arg;
+    char path[4096];
+    for (int i = 0; i < pf->count; i++) {
+        PrefetchSlot *slot = &pf->slots[i % pf->depth];
+        pthread_mutex_lock(&pf->lock);
+        while (slot->state != SLOT_EMPTY && !pf->aborted) {
+            pthread_cond_wait(&pf->space, &pf->lock);
+        }
+        int aborted = pf->aborted;
+        pthread_mutex_unlock(&pf->lock);
+        if (aborted) {
+            break;
+        }
+
+        int64_t start = av_gettime_relative();
+        int err = seq_path(pf->seq, i, path, sizeof(path));
+        if (err >= 0) {
+            err = load_file(path, slot);
+        }
+        if (err < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Could not read %s: %s\n", path, av_err2str(err));
+        }
+
+        pthread_mutex_lock(&pf->lock);
+        pf->read_us += av_gettime_relative() - start;
+        if (err >= 0) {
+            pf->bytes += slot->buf.size;
+        }
+        slot->buf.index = i;
+        slot->error = err;
+        slot->state = SLOT_READY;
+        pthread_cond_broadcast(&pf->ready);
+        pthread_mutex_unlock(&pf->lock);
+    }
+    return NULL;
+}
+
+int prefetch_start(Prefetcher **ppf, const FrameSeq *seq, int depth) {
+    Prefetcher *pf = av_mallocz(sizeof(*pf));
+    if (!pf) {
+        return AVERROR(ENOMEM);
+    }
+    pf->seq = seq;
+    pf->count = seq_count(seq);
+    pf->depth = FFMAX(depth, 1);
+    pf->slots = av_calloc(pf->depth, sizeof(*pf->slots));
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->ready, NULL);
+    pthread_cond_init(&pf->space, NULL);
+    if (!pf->slots) {
+        prefetch_stop(&pf);
+        return AVERROR(ENOMEM);
+    }
+    for (int k = 0; k < pf->depth; k++) {
+        pf->slots[k].buf.owner = pf;
+    }
+    int ret = pthread_create(&pf->thread, NULL, prefetch_thread, pf);
+    if (ret != 0) {
+        prefetch_stop(&pf);
+        return AVERROR(ret);
+    }
+    pf->thread_started = 1;
+    *ppf = pf;
+    return 0;
+}
+
+int prefetch_get(Prefetcher *pf, int index, PrefetchBuf **buf) {
+    PrefetchSlot *slot = &pf->slots[index % pf->depth];
+    pthread_mutex_lock(&pf->lock);
+    if (slot->state == SLOT_READY && slot->buf.index == index) {
+        pf->hits++;
+    } else {
+        // 预读没跟上，计入等待
+        int64_t start = av_gettime_relative();
+        while (!(slot->state == SLOT_READY && slot->buf.index == index) && !pf->aborted) {
+            pthread_cond_wait(&pf->ready, &pf->lock);
+        }
+        pf->stalls++;
+        pf->stall_us += av_gettime_relative() - start;
+    }
+    if (pf->aborted) {
+        pthread_mutex_unlock(&pf->lock);
+        return AVERROR_EXIT;
+    }
+    slot->state = SLOT_IN_USE;
+    int err = slot->error;
+    pthread_mutex_unlock(&pf->lock);
+    if (err < 0) {
+        prefetch_release(&slot->buf);
+        return err;
+    }
+    *buf = &slot->buf;
+    return 0;
+}
+
+void prefetch_release(PrefetchBuf *buf) {
+    if (!buf) {
+        return;
+    }
+    Prefetcher *pf = buf->owner;
+    PrefetchSlot *slot = (PrefetchSlot *) buf;
+    if (slot->map) {
+        munmap(slot->map, buf->size);
+        slot->map = NULL;
+    }
+    buf->data = NULL;
+    buf->size = 0;
+    pthread_mutex_lock(&pf->lock);
+    slot->state = SLOT_EMPTY;
+    pthread_cond_broadcast(&pf->space);
+    pthread_mutex_unlock(&pf->lock);
+}
+
+void prefetch_abort(Prefetcher *pf) {
+    if (!pf) {
+        return;
+    }
+    pthread_mutex_lock(&pf->lock);
+    pf->aborted = 1;
+    pthread_cond_broadcast(&pf->ready);
+    pthread_cond_broadcast(&pf->space);
+    pthread_mutex_unlock(&pf->lock);
+}
+
+void prefetch_stop(Prefetcher **ppf) {
+    Prefetcher *pf = *ppf;
+    if (!pf) {
+        return;
+    }
+    if (pf->thread_started) {
+        prefetch_abort(pf);
+        pthread_join(pf->thread, NULL);
+        av_log(NULL, AV_LOG_INFO,
+               "prefetch: depth %d, %"PRId64" hits, %"PRId64" stalls (%.3f s), %.1f MB read in %.3f s\n",
+               pf->depth, pf->hits, pf->stalls, pf->stall_us / 1000000.0,
+               pf->bytes / 1048576.0, pf->read_us / 1000000.0);
+    }
+    if (pf->slots) {
+        for (int k = 0; k < pf->depth; k++) {
+            if (pf->slots[k].map) {
+                munmap(pf->slots[k].map, pf->slots[k].buf.size);
+            }
+        }
+        av_free(pf->slots);
+    }
+    pthread_mutex_destroy(&pf->lock);
+    pthread_cond_destroy(&pf->ready);
+    pthread_cond_destroy(&pf->space);
+    av_freep(ppf);
+}
+
+typedef struct MemReader {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+} MemReader;
+
+static int mem_read_cb(void *opaque, uint8_t *buf, int size) {
+    MemReader *r = opaque;
+    size_t left = r->size - r->pos;
+    if (left == 0) {
+        return AVERROR_EOF;
+    }
+    size = (int) FFMIN((size_t) size, left);
+    memcpy(buf, r->data + r->pos, size);
+    r->pos += size;
+    return size;
+}
+
+static int64_t mem_seek_cb(void *opaque, int64_t offset, int whence) {
+    MemReader *r = opaque;
+    if (whence & AVSEEK_SIZE) {
+        return r->size;
+    }
+    switch (whence & ~AVSEEK_FORCE) {
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            offset += r->pos;
+            break;
+        case SEEK_END:
+            offset += r->size;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    if (offset < 0 || (size_t) offset > r->size) {
+        return AVERROR(EINVAL);
+    }
+    r->pos = offset;
+    return offset;
+}
+
+AVIOContext *prefetch_avio_alloc(const uint8_t *data, size_t size) {
+    const int io_size = 32768;
+    MemReader *r = av_mallocz(sizeof(*r));
+    uint8_t *io_buf = av_malloc(io_size);
+    if (!r || !io_buf) {
+        av_free(r);
+        av_free(io_buf);
+        return NULL;
+    }
+    r->data = data;
+    r->size = size;
+    AVIOContext *pb = avio_alloc_context(io_buf, io_size, 0, r, mem_read_cb, NULL, mem_seek_cb);
+    if (!pb) {
+        av_free(r);
+        av_free(io_buf);
+    }
+    return pb;
+}
+
+void prefetch_avio_free(AVIOContext **pb) {
+    if (!*pb) {
+        return;
+    }
+    av_freep(&(*pb)->opaque);
+    av_freep(&(*pb)->buffer);
+    avio_context_free(pb);
+}
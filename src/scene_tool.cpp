@@ -0,0 +1,179 @@
+#include "scene_tool.h"
+
+#include <Magick++.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "gm_tool.h"
+#include "track_tool.h"
+
+extern "C" {
+#include <libavutil/log.h>
+#include <libavutil/time.h>
+}
+
+Scene::Scene(double precision, size_t max_entries, size_t max_bytes, bool yuv)
+        : precision_(precision), max_entries_(max_entries), max_bytes_(max_bytes), yuv_(yuv) {
+}
+
+bool Scene::addLayer(const char *image, const char *track) {
+    std::unique_ptr<Layer> layer(new Layer);
+    layer->image = image;
+
+    // 位置文件优先使用编译好的二进制轨迹（mmap，不解析），JSON 只在轨迹过期或不存在时解析一次并重新生成
+    int64_t load_start = av_gettime_relative();
+    const char *how = "json";
+    if (!loadTrackCached(track, &layer->track, &how)) {
+        return false;
+    }
+    av_log(NULL, AV_LOG_INFO, "layer %zu: %s, positions: %zu entries over %zu frames, %.1f MB%s, %s, loaded in %.3f s\n",
+           layers_.size(), image, layer->track.count(), layer->track.frames(), layer->track.bytes() / 1048576.0,
+           layer->track.mapped() ? " mapped" : "", how, (av_gettime_relative() - load_start) / 1000000.0);
+    caches_[layer->image];
+    layers_.push_back(std::move(layer));
+    return true;
+}
+
+bool Scene::addLayers(const char *scene_file) {
+    std::ifstream in(scene_file);
+    if (!in) {
+        av_log(NULL, AV_LOG_ERROR, "Could not open scene: %s\n", scene_file);
+        return false;
+    }
+    std::string line;
+    for (int n = 1; std::getline(in, line); n++) {
+        std::istringstream fields(line);
+        std::string image, track;
+        if (!(fields >> image) || image[0] == '#') {
+            continue;
+        }
+        if (!(fields >> track)) {
+            av_log(NULL, AV_LOG_ERROR, "%s:%d: missing position file\n", scene_file, n);
+            return false;
+        }
+        if (!addLayer(image.c_str(), track.c_str())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Scene::open() {
+    // 旋转缓存的内存上限由各图片平分，条目数上限各自独立
+    size_t bytes = max_bytes_ / std::max<size_t>(1, caches_.size());
+    for (auto &entry: caches_) {
+        Magick::Image overlay;
+        overlay.read(entry.first);
+        overlay.backgroundColor(Magick::Color("#ffffffff"));
+        entry.second.reset(new OverlayCache(overlay, precision_, max_entries_, bytes, yuv_));
+    }
+    for (auto &layer: layers_) {
+        layer->cache = caches_[layer->image].get();
+    }
+}
+
+static bool rects_touch(const SceneRect &a, const SceneRect &b) {
+    return a.x <= b.x + b.width && b.x <= a.x + a.width && a.y <= b.y + b.height && b.y <= a.y + a.height;
+}
+
+// 把相交或相邻的矩形合并为包围盒，直到互不相交；层数通常只有几十，平方复杂度足够
+static void merge_rects(std::vector<SceneRect> *rects) {
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (size_t a = 0; a < rects->size() && !merged; a++) {
+            for (size_t b = a + 1; b < rects->size(); b++) {
+                SceneRect &ra = (*rects)[a];
+                const SceneRect &rb = (*rects)[b];
+                if (!rects_touch(ra, rb)) {
+                    continue;
+                }
+                int x1 = std::max(ra.x + ra.width, rb.x + rb.width);
+                int y1 = std::max(ra.y + ra.height, rb.y + rb.height);
+                ra.x = std::min(ra.x, rb.x);
+                ra.y = std::min(ra.y, rb.y);
+                ra.width = x1 - ra.x;
+                ra.height = y1 - ra.y;
+                rects->erase(rects->begin() + b);
+                merged = true;
+                break;
+            }
+        }
+    }
+    std::sort(rects->begin(), rects->end(), [](const SceneRect &a, const SceneRect &b) {
+        return a.y != b.y ? a.y < b.y : a.x < b.x;
+    });
+}
+
+int Scene::render(AVFrame *frame, int index, std::vector<SceneRect> *dirty) {
+    dirty->clear();
+    int composited = 0;
+    uint64_t layer_pixels = 0;
+    for (auto &layer: layers_) {
+        const Position *position = layer->track.find(index);
+        if (!position) {
+            continue;
+        }
+        std::shared_ptr<const RotatedOverlay> overlay = layer->cache->get(position->degrees);
+        // 与混合函数相同的取整与裁剪
+        int x = (int) (position->offsetX + overlay->dx);
+        int y = (int) (position->offsetY + overlay->dy);
+        int x0 = std::max(x, 0), y0 = std::max(y, 0);
+        int x1 = std::min(x + overlay->width, frame->width);
+        int y1 = std::min(y + overlay->height, frame->height);
+        if (x0 >= x1 || y0 >= y1) {
+            continue;
+        }
+        if (yuv_) {
+            composite_to_yuv_frame(frame, overlay.get(), position->offsetX, position->offsetY);
+            // 色度样本覆盖 2x2 亮度块
+            x0 &= ~1;
+            y0 &= ~1;
+            x1 = std::min(x1 + (x1 & 1), frame->width);
+            y1 = std::min(y1 + (y1 & 1), frame->height);
+        } else {
+            composite_to_frame_plus(frame, overlay.get(), position->offsetX, position->offsetY);
+        }
+        dirty->push_back(SceneRect{x0, y0, x1 - x0, y1 - y0});
+        layer_pixels += (uint64_t) (x1 - x0) * (y1 - y0);
+        composited++;
+    }
+    merge_rects(dirty);
+
+    uint64_t dirty_pixels = 0;
+    for (const SceneRect &rect: *dirty) {
+        dirty_pixels += (uint64_t) rect.width * rect.height;
+    }
+    frames_++;
+    composited_ += composited;
+    layer_pixels_ += layer_pixels;
+    dirty_pixels_ += dirty_pixels;
+    frame_pixels_ += (uint64_t) frame->width * frame->height;
+    return composited;
+}
+
+void Scene::log() const {
+    uint64_t frames = frames_, frame_pixels = frame_pixels_;
+    av_log(NULL, AV_LOG_INFO, "scene: %zu layers, %zu images, %llu frames, %.2f layers per frame, "
+           "blended %.2f%% of frame area, dirty %.2f%%\n",
+           layers_.size(), caches_.size(), (unsigned long long) frames,
+           frames ? (double) composited_ / frames : 0.0,
+           frame_pixels ? 100.0 * layer_pixels_ / frame_pixels : 0.0,
+           frame_pixels ? 100.0 * dirty_pixels_ / frame_pixels : 0.0);
+
+    size_t hits = 0, misses = 0, evictions = 0, entries = 0, bytes = 0;
+    for (auto &entry: caches_) {
+        if (!entry.second) {
+            continue;
+        }
+        hits += entry.second->hits();
+        misses += entry.second->misses();
+        evictions += entry.second->evictions();
+        entries += entry.second->entries();
+        bytes += entry.second->bytes();
+    }
+    av_log(NULL, AV_LOG_INFO, "rotate cache: hits %zu, misses %zu, evictions %zu, entries %zu, %zu bytes\n",
+           hits, misses, evictions, entries, bytes);
+}
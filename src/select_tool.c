@@ -0,0 +1,169 @@
+#include "select_tool.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/log.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/parseutils.h>
+
+void select_options_init(SelectOptions *opts) {
+    opts->start = 0;
+    opts->end = -1;
+    opts->every = 1;
+    opts->fps = 0;
+    opts->keyframes = 0;
+    opts->seek_gap = 10 * AV_TIME_BASE;
+}
+
+static int parse_time(const char *name, const char *value, int64_t *out) {
+    int ret = av_parse_time(out, value, 1);
+    if (ret < 0 || *out < 0) {
+        av_log(NULL, AV_LOG_ERROR, "invalid time for %s: %s\n", name, value);
+        return AVERROR(EINVAL);
+    }
+    return 1;
+}
+
+int select_options_parse(SelectOptions *opts, const char *name, const char *value) {
+    if (strcmp(name, "start") == 0) {
+        return parse_time(name, value, &opts->start);
+    } else if (strcmp(name, "end") == 0) {
+        return parse_time(name, value, &opts->end);
+    } else if (strcmp(name, "seek-gap") == 0) {
+        return parse_time(name, value, &opts->seek_gap);
+    } else if (strcmp(name, "every") == 0) {
+        opts->every = atoi(value);
+        if (opts->every < 1) {
+            return AVERROR(EINVAL);
+        }
+    } else if (strcmp(name, "fps") == 0) {
+        opts->fps = strtod(value, NULL);
+        if (opts->fps <= 0) {
+            return AVERROR(EINVAL);
+        }
+    } else if (strcmp(name, "keyframes") == 0) {
+        opts->keyframes = atoi(value) != 0;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// 流时间戳换算成相对流起点的微秒
+static int64_t to_us(const FrameSelect *sel, int64_t ts) {
+    return av_rescale_q(ts - sel->origin, sel->st->time_base, AV_TIME_BASE_Q);
+}
+
+// seek 到 us 之前最近的关键帧并清空解码器，失败时退回顺序解码
+static int seek_to(FrameSelect *sel, int64_t us) {
+    int64_t ts = av_rescale_q(us, AV_TIME_BASE_Q, sel->st->time_base) + sel->origin;
+    int ret = av_seek_frame(sel->fmt_ctx, sel->st->index, ts, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_WARNING, "seek to %.3f s failed, decoding sequentially: %s\n",
+               us / 1000000.0, av_err2str(ret));
+        return 0;
+    }
+    avcodec_flush_buffers(sel->ctx);
+    sel->seeks++;
+    return 1;
+}
+
+int select_start(FrameSelect *sel, const SelectOptions *opts, AVFormatContext *fmt_ctx, int stream,
+                 AVCodecContext *ctx) {
+    memset(sel, 0, sizeof(*sel));
+    sel->opts = *opts;
+    sel->fmt_ctx = fmt_ctx;
+    sel->ctx = ctx;
+    sel->st = fmt_ctx->streams[stream];
+    sel->origin = sel->st->start_time != AV_NOPTS_VALUE ? sel->st->start_time : 0;
+    sel->next = opts->start;
+
+    AVRational rate = sel->st->avg_frame_rate.num ? sel->st->avg_frame_rate : sel->st->r_frame_rate;
+    if (rate.num > 0 && rate.den > 0) {
+        sel->half_frame = av_rescale(AV_TIME_BASE / 2, rate.den, rate.num);
+    }
+    // --every 在帧率已知时换算成时间间隔，这样不被选中的帧可以不解码
+    if (opts->fps > 0) {
+        sel->step = llrint(AV_TIME_BASE / opts->fps);
+    } else if (opts->every > 1 && rate.num > 0 && rate.den > 0) {
+        sel->step = av_rescale((int64_t) opts->every * AV_TIME_BASE, rate.den, rate.num);
+    }
+
+    if (opts->keyframes) {
+        ctx->skip_frame = AVDISCARD_NONKEY;
+    }
+    if (opts->start > 0) {
+        seek_to(sel, opts->start);
+    }
+    return 0;
+}
+
+int select_packet(FrameSelect *sel, AVPacket *pkt) {
+    if (sel->seek_pending) {
+        sel->seek_pending = 0;
+        if (seek_to(sel, sel->next)) {
+            // 这个包是 seek 之前读到的，丢弃后从新位置重新读
+            return 0;
+        }
+    }
+    if (sel->opts.keyframes && !(pkt->flags & AV_PKT_FLAG_KEY)) {
+        sel->dropped_packets++;
+        return 0;
+    }
+
+    // dts 单调递增且不大于 pts，超过 --end 之后不会再有要取的帧
+    int64_t dts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    if (sel->opts.end >= 0 && dts != AV_NOPTS_VALUE && to_us(sel, dts) > sel->opts.end) {
+        return AVERROR_EOF;
+    }
+
+    if (!sel->opts.keyframes) {
+        // 还没到下一个要取的时间点，非参考帧解码了也没用
+        int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : dts;
+        int unwanted = pts != AV_NOPTS_VALUE && to_us(sel, pts) + sel->half_frame < sel->next;
+        sel->ctx->skip_frame = unwanted ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+        if (unwanted) {
+            sel->nonref_packets++;
+        }
+    }
+    return 1;
+}
+
+int select_frame(FrameSelect *sel, const AVFrame *frame) {
+    int64_t ts = frame->best_effort_timestamp != AV_NOPTS_VALUE ? frame->best_effort_timestamp : frame->pts;
+    if (ts != AV_NOPTS_VALUE) {
+        int64_t t = to_us(sel, ts);
+        if (sel->opts.end >= 0 && t > sel->opts.end) {
+            return AVERROR_EOF;
+        }
+        if (t + sel->half_frame < sel->next) {
+            return 0;
+        }
+        if (sel->step > 0) {
+            // 保持时间点落在 start + k * step 上，跳过已经错过的点。与上面的判断使用同一个容差，
+            // 否则在容差内提前选中的帧不推进时间点，下一帧会被再选一次
+            int64_t due = t + sel->half_frame;
+            if (sel->next <= due) {
+                sel->next += ((due - sel->next) / sel->step + 1) * sel->step;
+            }
+            if (sel->opts.seek_gap > 0 && sel->next - t > sel->opts.seek_gap) {
+                sel->seek_pending = 1;
+            }
+        }
+    }
+    if (sel->step == 0 && sel->opts.every > 1 && sel->counter++ % sel->opts.every != 0) {
+        return 0;
+    }
+    sel->selected++;
+    return 1;
+}
+
+void select_log(const FrameSelect *sel) {
+    av_log(NULL, AV_LOG_INFO,
+           "select: %"PRId64" frames, %"PRId64" seeks, %"PRId64" packets dropped, "
+           "%"PRId64" packets decoded without non-reference frames\n",
+           sel->selected, sel->seeks, sel->dropped_packets, sel->nonref_packets);
+}
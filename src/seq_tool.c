@@ -0,0 +1,300 @@
+#include "seq_tool.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libavutil/error.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+
+struct FrameSeq {
+    SeqOptions opts;
+    char *dir;          // 模板所在目录，没有时为 "."
+    int has_dir;
+    char *prefix;       // %d 之前的文件名部分
+    char *suffix;       // %d 之后的文件名部分
+    int zero_pad;
+    int width;
+    int count;
+    int last_shard;     // 最近一次创建的分片目录
+};
+
+void seq_options_init(SeqOptions *opts) {
+    opts->start = 1;
+    opts->end = -1;
+    opts->step = 1;
+    opts->shard = 0;
+}
+
+int seq_options_parse(SeqOptions *opts, const char *name, const char *value) {
+    if (strcmp(name, "start-number") == 0) {
+        opts->start = atoi(value);
+        if (opts->start < 0) {
+            return AVERROR(EINVAL);
+        }
+    } else if (strcmp(name, "end-number") == 0) {
+        opts->end = atoi(value);
+    } else if (strcmp(name, "step") == 0) {
+        opts->step = atoi(value);
+        if (opts->step <= 0) {
+            return AVERROR(EINVAL);
+        }
+    } else if (strcmp(name, "shard") == 0) {
+        opts->shard = atoi(value);
+        if (opts->shard < 0) {
+            return AVERROR(EINVAL);
+        }
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+int seq_open(FrameSeq **seq, const char *pattern, const SeqOptions *opts) {
+    FrameSeq *s = av_mallocz(sizeof(*s));
+    if (!s) {
+        return AVERROR(ENOMEM);
+    }
+    s->opts = *opts;
+    s->last_shard = -1;
+
+    const char *base = strrchr(pattern, '/');
+    if (base) {
+        s->dir = av_strndup(pattern, base == pattern ? 1 : base - pattern);
+        s->has_dir = 1;
+        base++;
+    } else {
+        s->dir = av_strdup(".");
+        base = pattern;
+    }
+
+    // 模板只能在文件名部分有一个 %d
+    const char *conv = strchr(base, '%');
+    const char *p = conv;
+    if (p) {
+        p++;
+        if (*p == '0') {
+            s->zero_pad = 1;
+            p++;
+        }
+        while (isdigit((unsigned char) *p)) {
+            s->width = s->width * 10 + (*p++ - '0');
+        }
+    }
+    if (!conv || *p != 'd' || strchr(p + 1, '%') || memchr(pattern, '%', base - pattern)) {
+        av_log(NULL, AV_LOG_ERROR, "Invalid sequence pattern: %s\n", pattern);
+        seq_free(&s);
+        return AVERROR(EINVAL);
+    }
+    s->prefix = av_strndup(base, conv - base);
+    s->suffix = av_strdup(p + 1);
+    if (!s->dir || !s->prefix || !s->suffix) {
+        seq_free(&s);
+        return AVERROR(ENOMEM);
+    }
+    *seq = s;
+    return 0;
+}
+
+void seq_free(FrameSeq **seq) {
+    FrameSeq *s = *seq;
+    if (!s) {
+        return;
+    }
+    av_free(s->dir);
+    av_free(s->prefix);
+    av_free(s->suffix);
+    av_freep(seq);
+}
+
+static int format_number(const FrameSeq *s, int number, char *buf, size_t size) {
+    return snprintf(buf, size, s->zero_pad ? "%0*d" : "%*d", s->width, number);
+}
+
+// 分片子目录路径，不分片时就是模板目录
+static int shard_dir(const FrameSeq *s, int number, char *buf, size_t size) {
+    char name[32];
+    if (s->opts.shard <= 0) {
+        return snprintf(buf, size, "%s", s->dir);
+    }
+    format_number(s, number / s->opts.shard * s->opts.shard, name, sizeof(name));
+    if (!s->has_dir) {
+        return snprintf(buf, size, "%s", name);
+    }
+    return snprintf(buf, size, "%s/%s", s->dir, name);
+}
+
+static int number_path(const FrameSeq *s, int number, char *buf, size_t size) {
+    char name[32];
+    int n = 0;
+    if (s->has_dir || s->opts.shard > 0) {
+        n = shard_dir(s, number, buf, size);
+        if (n < 0 || (size_t) n >= size) {
+            return AVERROR(ENAMETOOLONG);
+        }
+        buf[n++] = '/';
+    }
+    format_number(s, number, name, sizeof(name));
+    n += snprintf(buf + n, size - n, "%s%s%s", s->prefix, name, s->suffix);
+    if ((size_t) n >= size) {
+        return AVERROR(ENAMETOOLONG);
+    }
+    return 0;
+}
+
+typedef struct ScanList {
+    int *numbers;
+    int count;
+    int capacity;
+} ScanList;
+
+// 读取一个目录，收集所有与模板完全匹配的编号，返回 0 或目录不存在时的 AVERROR(ENOENT)
+static int scan_dir(const FrameSeq *s, const char *path, ScanList *list) {
+    size_t prefix_len = strlen(s->prefix);
+    size_t suffix_len = strlen(s->suffix);
+    char name[32];
+
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return AVERROR(errno);
+    }
+    struct dirent *e;
+    while ((e = readdir(dir))) {
+        size_t len = strlen(e->d_name);
+        if (len <= prefix_len + suffix_len
+            || strncmp(e->d_name, s->prefix, prefix_len) != 0
+            || strcmp(e->d_name + len - suffix_len, s->suffix) != 0) {
+            continue;
+        }
+        const char *digits = e->d_name + prefix_len;
+        size_t digits_len = len - prefix_len - suffix_len;
+        if (digits_len >= 10) {
+            continue;
+        }
+        char *end;
+        long number = strtol(digits, &end, 10);
+        if (end != digits + digits_len || number < 0) {
+            continue;
+        }
+        // 与 sprintf 生成的名字一致才算，保证和原来的逐个 access() 结果相同
+        format_number(s, (int) number, name, sizeof(name));
+        if (strlen(name) != digits_len || memcmp(name, digits, digits_len) != 0) {
+            continue;
+        }
+        if (list->count == list->capacity) {
+            int capacity = list->capacity ? list->capacity * 2 : 1024;
+            int *numbers = av_realloc_array(list->numbers, capacity, sizeof(*numbers));
+            if (!numbers) {
+                closedir(dir);
+                return AVERROR(ENOMEM);
+            }
+            list->numbers = numbers;
+            list->capacity = capacity;
+        }
+        list->numbers[list->count++] = (int) number;
+    }
+    closedir(dir);
+    return 0;
+}
+
+static int compare_int(const void *a, const void *b) {
+    int x = *(const int *) a, y = *(const int *) b;
+    return (x > y) - (x < y);
+}
+
+int seq_scan(FrameSeq *s) {
+    ScanList list = {0};
+    char path[4096];
+    int ret = 0;
+
+    if (s->opts.shard <= 0) {
+        ret = scan_dir(s, s->dir, &list);
+    } else {
+        // 从第一帧所在的分片开始依次读取，直到分片目录不存在
+        for (int first = s->opts.start / s->opts.shard * s->opts.shard;
+             s->opts.end < 0 || first <= s->opts.end; first += s->opts.shard) {
+            if (shard_dir(s, first, path, sizeof(path)) >= (int) sizeof(path)) {
+                ret = AVERROR(ENAMETOOLONG);
+                break;
+            }
+            ret = scan_dir(s, path, &list);
+            if (ret == AVERROR(ENOENT)) {
+                ret = 0;
+                break;
+            } else if (ret < 0) {
+                break;
+            }
+        }
+    }
+    if (ret < 0 && ret != AVERROR(ENOENT)) {
+        av_log(NULL, AV_LOG_ERROR, "Could not scan %s: %s\n", s->dir, av_err2str(ret));
+        av_free(list.numbers);
+        return ret;
+    }
+
+    // 按 start/step 取连续的帧，遇到缺失停止
+    if (list.count > 0) {
+        qsort(list.numbers, list.count, sizeof(*list.numbers), compare_int);
+    }
+    int j = 0;
+    int expected = s->opts.start;
+    s->count = 0;
+    while (s->opts.end < 0 || expected <= s->opts.end) {
+        while (j < list.count && list.numbers[j] < expected) {
+            j++;
+        }
+        if (j == list.count || list.numbers[j] != expected) {
+            break;
+        }
+        s->count++;
+        expected += s->opts.step;
+    }
+    if (j < list.count && list.numbers[list.count - 1] > expected
+        && (s->opts.end < 0 || list.numbers[list.count - 1] <= s->opts.end)) {
+        av_log(NULL, AV_LOG_WARNING, "Frame %d is missing, later frames are ignored\n", expected);
+    }
+    av_log(NULL, AV_LOG_INFO, "seq: %d frames, %d matching files scanned\n", s->count, list.count);
+    av_free(list.numbers);
+    return s->count;
+}
+
+int seq_count(const FrameSeq *seq) {
+    return seq->count;
+}
+
+int seq_number(const FrameSeq *seq, int index) {
+    return seq->opts.start + index * seq->opts.step;
+}
+
+int seq_path(const FrameSeq *seq, int index, char *buf, size_t size) {
+    return number_path(seq, seq_number(seq, index), buf, size);
+}
+
+int seq_output_path(FrameSeq *seq, int index, char *buf, size_t size) {
+    int number = seq_number(seq, index);
+    int ret = number_path(seq, number, buf, size);
+    if (ret < 0 || seq->opts.shard <= 0) {
+        return ret;
+    }
+
+    // 进入新的分片时创建子目录
+    int shard = number / seq->opts.shard;
+    if (shard != seq->last_shard) {
+        char *slash = strrchr(buf, '/');
+        *slash = '\0';
+        if (mkdir(buf, 0755) < 0 && errno != EEXIST) {
+            ret = AVERROR(errno);
+            av_log(NULL, AV_LOG_ERROR, "Could not create directory %s: %s\n", buf, av_err2str(ret));
+            *slash = '/';
+            return ret;
+        }
+        *slash = '/';
+        seq->last_shard = shard;
+    }
+    return 0;
+}
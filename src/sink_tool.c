@@ -0,0 +1,368 @@
+#include "sink_tool.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libavutil/common.h>
+#include <libavutil/error.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+#include <libswscale/swscale.h>
+
+#include "conv_tool.h"
+
+// 写出前把文件头写入 buf，返回文件头长度
+typedef int (*SinkHeader)(uint8_t *buf, const AVFrame *frame, int row_size);
+
+typedef struct SinkType {
+    const char *name;
+    enum AVPixelFormat format;  // 写入前转换到的格式
+    int pixel_size;             // 每像素字节数
+    int row_align;              // 每行补齐到的字节数
+    int bottom_up;              // 自下而上存放行
+    SinkHeader header;          // 为 NULL 时交给 PNG 写线程池或单文件
+    int packed;                 // 所有帧写进一个文件，像素格式由 pack_tool 决定
+} SinkType;
+
+struct FrameSink {
+    const SinkType *type;
+    FrameSeq *seq;
+    ConvCache conv;
+    AVFrame *scratch;
+    PngWriter *png;
+    OutWriter *out;
+    PackWriter *pack;
+
+    pthread_t thread;
+    int thread_started;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t space;
+    AVFrame **frames;       // 环形队列，持有解码帧的引用
+    int *indices;
+    int depth;
+    int head;
+    int count;
+    int eof;
+    int error;
+
+    // 统计
+    int64_t written;
+    int64_t busy_us;
+    int64_t push_stalls;
+    int64_t push_wait_us;
+};
+
+static int pgm_header(uint8_t *buf, const AVFrame *frame, int row_size) {
+    return snprintf((char *) buf, 64, "P5\n%d %d\n%d\n", frame->width, frame->height, 255);
+}
+
+static int ppm_header(uint8_t *buf, const AVFrame *frame, int row_size) {
+    return snprintf((char *) buf, 64, "P6\n%d %d\n255\n", frame->width, frame->height);
+}
+
+static void put_le16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    put_le16(p, v);
+    put_le16(p + 2, v >> 16);
+}
+
+// 24 位 BMP 文件头与信息头
+static int bmp_header(uint8_t *buf, const AVFrame *frame, int row_size) {
+    uint32_t image_size = (uint32_t) row_size * frame->height;
+    memset(buf, 0, 54);
+    buf[0] = 'B';
+    buf[1] = 'M';
+    put_le32(buf + 2, 54 + image_size);
+    put_le32(buf + 10, 54);
+    put_le32(buf + 14, 40);
+    put_le32(buf + 18, frame->width);
+    put_le32(buf + 22, frame->height);
+    put_le16(buf + 26, 1);
+    put_le16(buf + 28, 24);
+    put_le32(buf + 34, image_size);
+    return 54;
+}
+
+// BMP 为 BGR 排列，自下而上，每行补齐到 4 字节
+static const SinkType sink_types[] = {
+    {"pgm", AV_PIX_FMT_GRAY8, 1, 1, 0, pgm_header},
+    {"ppm", AV_PIX_FMT_RGB24, 3, 1, 0, ppm_header},
+    {"bmp", AV_PIX_FMT_BGR24, 3, 4, 1, bmp_header},
+    {"png", AV_PIX_FMT_RGB24, 3, 1, 0, NULL},
+    {"y4m", AV_PIX_FMT_NONE, 0, 0, 0, NULL, 1},
+    {"raw", AV_PIX_FMT_NONE, 0, 0, 0, NULL, 1},
+};
+
+static const SinkType *find_type(const char *name) {
+    for (int k = 0; k < FF_ARRAY_ELEMS(sink_types); k++) {
+        if (strcmp(sink_types[k].name, name) == 0) {
+            return &sink_types[k];
+        }
+    }
+    return NULL;
+}
+
+int sink_type_supported(const char *type) {
+    return find_type(type) != NULL;
+}
+
+// 解码帧可以不经转换直接写出时返回 1，8 位 YUV 的亮度平面直接当灰度图
+static int can_write_direct(const SinkType *type, const AVFrame *frame) {
+    if (frame->format == type->format) {
+        return 1;
+    }
+    if (type->format != AV_PIX_FMT_GRAY8) {
+        return 0;
+    }
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    return desc && !(desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL))
+           && desc->comp[0].plane == 0 && desc->comp[0].step == 1 && desc->comp[0].depth == 8;
+}
+
+// 文件头与按行排好的像素交给输出队列，一次写出
+static int write_file(FrameSink *s, const AVFrame *frame, const char *path) {
+    const SinkType *t = s->type;
+    int width = frame->width * t->pixel_size;
+    int row_size = FFALIGN(width, t->row_align);
+    OutFile *file;
+    int ret = out_writer_get(s->out, (size_t) row_size * frame->height, &file);
+    if (ret < 0) {
+        return ret;
+    }
+    file->header_size = t->header(file->header, frame, row_size);
+    for (int y = 0; y < frame->height; y++) {
+        uint8_t *dst = file->data + (size_t) row_size * (t->bottom_up ? frame->height - 1 - y : y);
+        memcpy(dst, frame->data[0] + (size_t) y * frame->linesize[0], width);
+        memset(dst + width, 0, row_size - width);
+    }
+    return out_writer_submit(s->out, file, path);
+}
+
+// 单文件按第一帧的布局写入，之后宽高或格式变化的帧转换成第一帧的布局
+static int pack_process(FrameSink *s, const AVFrame *in) {
+    int width, height;
+    enum AVPixelFormat format;
+    int ret = pack_writer_layout(s->pack, in, &width, &height, &format);
+    if (ret < 0) {
+        return ret;
+    }
+    if (in->width == width && in->height == height && in->format == format) {
+        return pack_writer_write(s->pack, in);
+    }
+    ret = conv_frame_alloc(s->scratch, width, height, format);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = conv_cache_convert(&s->conv, in, s->scratch, SWS_BILINEAR);
+    if (ret < 0) {
+        return ret;
+    }
+    return pack_writer_write(s->pack, s->scratch);
+}
+
+static int sink_process(FrameSink *s, const AVFrame *in, int index) {
+    if (s->pack) {
+        return pack_process(s, in);
+    }
+
+    char path[4096];
+    int ret = seq_output_path(s->seq, index, path, sizeof(path));
+    if (ret < 0) {
+        return ret;
+    }
+
+    AVFrame *out = s->scratch;
+    if (s->png) {
+        // PNG 由写线程池压缩，转换到池里取出的空闲帧
+        ret = png_writer_get(s->png, &out);
+        if (ret < 0) {
+            return ret;
+        }
+    } else if (can_write_direct(s->type, in)) {
+        return write_file(s, in, path);
+    }
+
+    ret = conv_frame_alloc(out, in->width, in->height, s->type->format);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = conv_cache_convert(&s->conv, in, out, SWS_BILINEAR);
+    if (ret < 0) {
+        return ret;
+    }
+    return s->png ? png_writer_submit(s->png, out, path) : write_file(s, out, path);
+}
+
+static void *sink_worker(void *arg) {
+    FrameSink *s = arg;
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        while (!s->count && !s->eof) {
+            pthread_cond_wait(&s->work, &s->lock);
+        }
+        if (!s->count) {
+            break;
+        }
+        // 处理完才出队，生产者不会覆盖正在使用的位置
+        AVFrame *frame = s->frames[s->head];
+        int index = s->indices[s->head];
+        int skip = s->error;
+        pthread_mutex_unlock(&s->lock);
+
+        int64_t start = av_gettime_relative();
+        int ret = skip ? 0 : sink_process(s, frame, index);
+        int64_t busy = av_gettime_relative() - start;
+        av_frame_unref(frame);
+
+        pthread_mutex_lock(&s->lock);
+        s->busy_us += busy;
+        if (ret < 0) {
+            if (!s->error) {
+                s->error = ret;
+            }
+        } else if (!skip) {
+            s->written++;
+        }
+        s->head = (s->head + 1) % s->depth;
+        s->count--;
+        pthread_cond_signal(&s->space);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+int sink_open(FrameSink **psink, const char *type, const char *pattern,
+              const SeqOptions *seq_opts, const PngOptions *png_opts, const OutOptions *out_opts,
+              const PackOptions *pack_opts, int queue) {
+    const SinkType *t = find_type(type);
+    if (!t) {
+        av_log(NULL, AV_LOG_ERROR, "Unknown output type: %s\n", type);
+        return AVERROR(EINVAL);
+    }
+    FrameSink *s = av_mallocz(sizeof(*s));
+    if (!s) {
+        return AVERROR(ENOMEM);
+    }
+    s->type = t;
+    s->depth = FFMAX(queue, 1);
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->work, NULL);
+    pthread_cond_init(&s->space, NULL);
+
+    // 单文件输出时 pattern 就是文件名
+    int ret = t->packed ? 0 : seq_open(&s->seq, pattern, seq_opts);
+    if (ret < 0) {
+        goto fail;
+    }
+    s->scratch = av_frame_alloc();
+    s->frames = av_calloc(s->depth, sizeof(*s->frames));
+    s->indices = av_calloc(s->depth, sizeof(*s->indices));
+    if (!s->scratch || !s->frames || !s->indices) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (int k = 0; k < s->depth; k++) {
+        s->frames[k] = av_frame_alloc();
+        if (!s->frames[k]) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+    }
+    if (t->packed) {
+        ret = pack_writer_open(&s->pack, t->name, pattern, pack_opts);
+    } else {
+        ret = t->header ? out_writer_open(&s->out, out_opts) : png_writer_start(&s->png, png_opts);
+    }
+    if (ret < 0) {
+        goto fail;
+    }
+    ret = pthread_create(&s->thread, NULL, sink_worker, s);
+    if (ret != 0) {
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    s->thread_started = 1;
+    *psink = s;
+    return 0;
+fail:
+    sink_close(&s);
+    return ret;
+}
+
+int sink_push(FrameSink *s, const AVFrame *frame, int index) {
+    pthread_mutex_lock(&s->lock);
+    if (s->count == s->depth && !s->error) {
+        // 该输出端跟不上，解码线程等待它腾出位置
+        int64_t start = av_gettime_relative();
+        while (s->count == s->depth && !s->error) {
+            pthread_cond_wait(&s->space, &s->lock);
+        }
+        s->push_stalls++;
+        s->push_wait_us += av_gettime_relative() - start;
+    }
+    int ret = s->error;
+    if (!ret) {
+        int tail = (s->head + s->count) % s->depth;
+        ret = av_frame_ref(s->frames[tail], frame);
+        if (ret >= 0) {
+            s->indices[tail] = index;
+            s->count++;
+            pthread_cond_signal(&s->work);
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+    return ret;
+}
+
+int sink_close(FrameSink **psink) {
+    FrameSink *s = *psink;
+    if (!s) {
+        return 0;
+    }
+    if (s->thread_started) {
+        pthread_mutex_lock(&s->lock);
+        s->eof = 1;
+        pthread_cond_signal(&s->work);
+        pthread_mutex_unlock(&s->lock);
+        pthread_join(s->thread, NULL);
+        av_log(NULL, AV_LOG_INFO,
+               "%s sink: %"PRId64" frames, busy %.3f s, decoder stalled %"PRId64" times (%.3f s)\n",
+               s->type->name, s->written, s->busy_us / 1000000.0, s->push_stalls, s->push_wait_us / 1000000.0);
+    }
+    int ret = png_writer_close(&s->png);
+    int out_ret = out_writer_close(&s->out);
+    if (out_ret < 0 && ret >= 0) {
+        ret = out_ret;
+    }
+    int pack_ret = pack_writer_close(&s->pack);
+    if (pack_ret < 0 && ret >= 0) {
+        ret = pack_ret;
+    }
+    if (s->error) {
+        ret = s->error;
+    }
+    if (s->frames) {
+        for (int k = 0; k < s->depth; k++) {
+            av_frame_free(&s->frames[k]);
+        }
+    }
+    av_free(s->frames);
+    av_free(s->indices);
+    av_frame_free(&s->scratch);
+    conv_cache_free(&s->conv);
+    seq_free(&s->seq);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->work);
+    pthread_cond_destroy(&s->space);
+    av_freep(psink);
+    return ret;
+}
@@ -0,0 +1,28 @@
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "json_tool.h"
+#include "track_tool.h"
+
+// 把位置 JSON 编译成二进制轨迹，ffmpeg_demo 可直接 mmap 使用
+// positions.json [positions.json.ptrk]
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s <positions.json> [output.ptrk]\n", argv[0]);
+        return 0;
+    }
+    const char *src = argv[1];
+    std::string dst = argc > 2 ? argv[2] : std::string(src) + ".ptrk";
+
+    TrackSource source;
+    PositionTrack track;
+    if (!trackSourceStat(src, &source, true) || !loadPositions(src, &track)) {
+        return -1;
+    }
+    if (!saveTrack(dst.c_str(), track, source)) {
+        return -1;
+    }
+    std::cout << dst << ": " << track.count() << " positions over " << track.frames() << " frames" << std::endl;
+    return 0;
+}
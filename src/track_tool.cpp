@@ -0,0 +1,257 @@
+#include "track_tool.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#define TRACK_MAGIC "FXPTRK01"
+#define TRACK_VERSION 1
+#define TRACK_HEADER_SIZE 128
+
+struct TrackHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    int32_t first;
+    uint32_t reserved;
+    uint64_t frames;
+    uint64_t count;
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+    uint64_t source_hash;
+};
+
+static_assert(sizeof(TrackHeader) <= TRACK_HEADER_SIZE, "track header too large");
+// 记录直接按 Position 读取
+static_assert(sizeof(Position) == 16, "unexpected record layout");
+
+static size_t bitmap_words(uint64_t frames) {
+    return (frames + 63) / 64;
+}
+
+static uint64_t records_offset(uint64_t frames) {
+    return (TRACK_HEADER_SIZE + bitmap_words(frames) * 8 + 63) & ~(uint64_t) 63;
+}
+
+bool trackSourceStat(const char *path, TrackSource *source, bool hash) {
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        std::cerr << "无法读取文件信息: " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    source->size = st.st_size;
+    source->mtime_ns = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    source->hash = 0;
+    if (!hash) {
+        return true;
+    }
+
+    std::unique_ptr<FILE, int (*)(FILE *)> file(fopen(path, "rb"), fclose);
+    if (!file) {
+        std::cerr << "无法打开文件: " << path << std::endl;
+        return false;
+    }
+    std::vector<unsigned char> buffer(1 << 20);
+    uint64_t h = UINT64_C(14695981039346656037);
+    size_t n;
+    while ((n = fread(buffer.data(), 1, buffer.size(), file.get())) > 0) {
+        for (size_t k = 0; k < n; k++) {
+            h = (h ^ buffer[k]) * UINT64_C(1099511628211);
+        }
+    }
+    // 0 留给“未计算”
+    source->hash = h ? h : 1;
+    return true;
+}
+
+static bool read_header(int fd, TrackHeader *header) {
+    if (pread(fd, header, sizeof(*header), 0) != (ssize_t) sizeof(*header)) {
+        return false;
+    }
+    return memcmp(header->magic, TRACK_MAGIC, 8) == 0 && header->version == TRACK_VERSION
+           && header->record_size == sizeof(Position);
+}
+
+bool isTrackFile(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    TrackHeader header;
+    bool ok = read_header(fd, &header);
+    close(fd);
+    return ok;
+}
+
+bool readTrackSource(const char *path, TrackSource *source) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    TrackHeader header;
+    bool ok = read_header(fd, &header);
+    close(fd);
+    if (ok) {
+        source->size = header.source_size;
+        source->mtime_ns = header.source_mtime_ns;
+        source->hash = header.source_hash;
+    }
+    return ok;
+}
+
+bool saveTrack(const char *path, const PositionTrack &track, const TrackSource &source) {
+    // 帧范围收紧到第一个与最后一个有位置的帧
+    int64_t begin = track.first(), end = track.first() + (int64_t) track.frames();
+    while (begin < end && !track.find((int) begin)) {
+        begin++;
+    }
+    while (end > begin && !track.find((int) end - 1)) {
+        end--;
+    }
+    TrackHeader header = {};
+    memcpy(header.magic, TRACK_MAGIC, 8);
+    header.version = TRACK_VERSION;
+    header.record_size = sizeof(Position);
+    header.first = (int32_t) begin;
+    header.frames = end - begin;
+    header.count = track.count();
+    header.source_size = source.size;
+    header.source_mtime_ns = source.mtime_ns;
+    header.source_hash = source.hash;
+
+    // 临时文件名唯一，多个进程同时重建同一条轨迹时互不覆盖，最后一次 rename 生效
+    std::string tmp = std::string(path) + ".XXXXXX";
+    int fd = mkstemp(tmp.data());
+    if (fd < 0) {
+        std::cerr << "无法创建文件: " << tmp << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    // mkstemp 按 0600 创建，改成与输出文件一致的 0644
+    std::unique_ptr<FILE, int (*)(FILE *)> file(fchmod(fd, 0644) == 0 ? fdopen(fd, "wb") : nullptr, fclose);
+    if (!file) {
+        std::cerr << "无法创建文件: " << tmp << ": " << strerror(errno) << std::endl;
+        close(fd);
+        unlink(tmp.c_str());
+        return false;
+    }
+    std::vector<char> buffer(1 << 20);
+    setvbuf(file.get(), buffer.data(), _IOFBF, buffer.size());
+
+    unsigned char head[TRACK_HEADER_SIZE] = {};
+    memcpy(head, &header, sizeof(header));
+    bool ok = fwrite(head, sizeof(head), 1, file.get()) == 1;
+
+    std::vector<uint64_t> bitmap(bitmap_words(header.frames));
+    for (uint64_t i = 0; i < header.frames; i++) {
+        if (track.find((int) (begin + i))) {
+            bitmap[i >> 6] |= UINT64_C(1) << (i & 63);
+        }
+    }
+    ok = ok && fwrite(bitmap.data(), 8, bitmap.size(), file.get()) == bitmap.size();
+    size_t pad = records_offset(header.frames) - TRACK_HEADER_SIZE - bitmap.size() * 8;
+    ok = ok && fwrite(head + sizeof(header), 1, pad, file.get()) == pad;
+
+    // 没有位置的帧写全零记录，保持定长
+    for (uint64_t i = 0; ok && i < header.frames; i++) {
+        const Position *p = track.find((int) (begin + i));
+        Position position = p ? *p : Position{0, 0, 0};
+        ok = fwrite(&position, sizeof(position), 1, file.get()) == 1;
+    }
+    ok = ok && fflush(file.get()) == 0;
+    file.reset();
+    if (!ok || rename(tmp.c_str(), path) < 0) {
+        std::cerr << "无法写入文件: " << path << ": " << strerror(errno) << std::endl;
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool openTrack(const char *path, PositionTrack *track) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "无法打开文件: " << path << std::endl;
+        return false;
+    }
+    TrackHeader header;
+    struct stat st;
+    bool ok = read_header(fd, &header) && fstat(fd, &st) == 0;
+    uint64_t size = ok ? records_offset(header.frames) + header.frames * header.record_size : 0;
+    if (!ok || (uint64_t) st.st_size != size || header.frames > INT32_MAX) {
+        std::cerr << "不是有效的位置轨迹文件: " << path << std::endl;
+        close(fd);
+        return false;
+    }
+    void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        std::cerr << "无法映射文件: " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    const uint8_t *base = static_cast<const uint8_t *>(map);
+    track->attach(map, size, header.first, header.frames, header.count,
+                  reinterpret_cast<const uint64_t *>(base + TRACK_HEADER_SIZE),
+                  reinterpret_cast<const Position *>(base + records_offset(header.frames)));
+    return true;
+}
+
+// JSON 未改动时记录的修改时间与实际不同（例如重新拷贝过），哈希相同后把新的修改时间写回，下次不必再算哈希
+static void refresh_source(const char *path, const TrackSource &source) {
+    int fd = open(path, O_WRONLY);
+    if (fd >= 0) {
+        if (pwrite(fd, &source.mtime_ns, sizeof(source.mtime_ns), offsetof(TrackHeader, source_mtime_ns)) < 0) {
+            std::cerr << "无法更新文件: " << path << std::endl;
+        }
+        close(fd);
+    }
+}
+
+bool loadTrackCached(const char *path, PositionTrack *track, const char **how) {
+    if (isTrackFile(path)) {
+        *how = "binary track";
+        return openTrack(path, track);
+    }
+
+    TrackSource source, cached;
+    if (!trackSourceStat(path, &source, false)) {
+        return false;
+    }
+    std::string cache = std::string(path) + ".ptrk";
+    if (readTrackSource(cache.c_str(), &cached) && cached.size == source.size) {
+        if (cached.mtime_ns == source.mtime_ns) {
+            *how = "cached binary track";
+            return openTrack(cache.c_str(), track);
+        }
+        if (!trackSourceStat(path, &source, true)) {
+            return false;
+        }
+        if (cached.hash == source.hash) {
+            refresh_source(cache.c_str(), source);
+            *how = "cached binary track (hash verified)";
+            return openTrack(cache.c_str(), track);
+        }
+    }
+
+    // 缓存不存在或已过期：解析 JSON 并重新生成，生成失败不影响本次运行
+    if (!loadPositions(path, track)) {
+        return false;
+    }
+    *how = "json, binary track rebuilt";
+    if (!source.hash && !trackSourceStat(path, &source, true)) {
+        return true;
+    }
+    if (!saveTrack(cache.c_str(), *track, source)) {
+        *how = "json";
+    }
+    return true;
+}